@@ -0,0 +1,78 @@
+/* Throughput of the crc64 implementations across buffer sizes; store_output
+ * hashes HASH_BUFFER_SIZE (1 KB) pieces when output checking is on.
+ *
+ * usage: crc64-throughput [megabytes]
+ *   megabytes   hashed per implementation and size (default 256)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "../include/output/crc64.h"
+
+// keeps the results live, so the loops are not optimised away
+static volatile uint64_t sink;
+
+typedef uint64_t (*crc64_fn)(uint64_t, const unsigned char*, uint64_t);
+
+static uint64_t clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[])
+{
+    static const uint64_t sizes[] = {64, 256, 1024, 4096, 65536, 1048576};
+    static const char* names[] = {"bytewise", "slice-by-8", "slice-by-16", "pclmul"};
+    crc64_fn impls[] = {crc64_bytewise, crc64_slice8, crc64_slice16, crc64_pclmul};
+    uint64_t total = (uint64_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+    uint32_t impl_count = crc64_pclmul_supported() ? 4 : 3;
+    uint32_t i, k;
+    unsigned char* buf = (unsigned char*)malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+
+    if (total == 0 || NULL == buf) {
+        fprintf(stderr, "usage: %s [megabytes > 0]\n", argv[0]);
+        return 1;
+    }
+    for (i = 0; i < sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]; i++)
+        buf[i] = (unsigned char)rand();
+
+    crc64_setup();
+    printf("crc64 uses %s%s\n", crc64_impl_name(), crc64_pclmul_supported() ? "" : " (no PCLMULQDQ on this CPU)");
+    if (crc64(0, (const unsigned char*)"123456789", 9) != UINT64_C(0xe9c6d914c4b8d9ca)) {
+        fprintf(stderr, "check value mismatch\n");
+        return 1;
+    }
+
+    printf("\n%10s", "bytes");
+    for (k = 0; k < impl_count; k++)
+        printf(" %12s", names[k]);
+    printf("   (GB/s)\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint64_t size = sizes[i], rounds = total / size, r;
+        uint64_t expect = crc64_bytewise(0, buf, size);
+        printf("%10"PRIu64, size);
+        for (k = 0; k < impl_count; k++) {
+            uint64_t crc = 0, start;
+            if (impls[k](0, buf, size) != expect) {
+                printf(" %12s", "MISMATCH");
+                continue;
+            }
+            // the bytewise loop is slow; it gets a sixteenth of the bytes
+            uint64_t n = (k == 0) ? rounds / 16 + 1 : rounds;
+            start = clock_ns();
+            for (r = 0; r < n; r++)
+                crc = impls[k](crc, buf, size);
+            double secs = (clock_ns() - start) / 1e9;
+            sink = crc;
+            printf(" %12.2f", (double)n * size / secs / 1e9);
+        }
+        printf("\n");
+    }
+    free(buf);
+    return 0;
+}
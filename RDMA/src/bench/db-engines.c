@@ -0,0 +1,163 @@
+/* Throughput and put/get latency of the storage engines, replaying a stream
+ * of request records keyed by view stamp the way the persistence thread and
+ * the apply path use them: a put per record in req_id order, then gets of
+ * random committed records.
+ *
+ * usage: db-engines [-n records] [-s min_size] [-S max_size] [-r rate]
+ *                   [-d durability] [-b batch] db_name...
+ *   records     records per engine (default 100000)
+ *   min/max     payload bytes, uniform between the two (default 64 and 1024)
+ *   rate        offered puts per second, 0 for as fast as possible (default 0);
+ *               a late put counts from when it was due
+ *   durability  none, async-flush, fsync-per-batch or fsync-per-record (default none)
+ *   batch       records per sync_db with fsync-per-batch (default 32)
+ *   db_name     as in the configuration: "mem:<name>", "wal:<dir>" or a BerkeleyDB file
+ */
+#include <stddef.h>
+#include <unistd.h>
+#include <time.h>
+#include "../include/ev_mgr/ev_mgr.h"
+
+FILE *log_fp;
+
+static uint64_t clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* op, uint64_t* lat, uint32_t n, uint64_t elapsed_ns)
+{
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+    printf("  %-4s %10.0f ops/s   p50 %8.1f us   p99 %8.1f us   p999 %8.1f us   max %8.1f us\n", op,
+        (double)n * 1e9 / elapsed_ns, lat[n / 2] / 1e3, lat[(uint64_t)n * 99 / 100] / 1e3,
+        lat[(uint64_t)n * 999 / 1000] / 1e3, lat[n - 1] / 1e3);
+}
+
+/* waits until the put is due; returns when it was */
+static uint64_t pace(uint64_t start, uint32_t i, uint32_t rate)
+{
+    if (0 == rate)
+        return clock_ns();
+    uint64_t due = start + (uint64_t)i * 1000000000 / rate;
+    while (clock_ns() < due)
+        ;
+    return due;
+}
+
+static int run(const char* db_name, uint32_t n, uint32_t min_size, uint32_t max_size, uint32_t rate, durability mode, uint32_t batch)
+{
+    db* db_p = initialize_db(db_name, 0, mode);
+    uint64_t *lat = (uint64_t*)malloc(sizeof(uint64_t) * n);
+    request_record* record = (request_record*)malloc(sizeof(request_record) + max_size + 1);
+    uint64_t start, elapsed, t;
+    uint32_t i;
+    db_stat stat;
+
+    if (NULL == db_p || NULL == lat || NULL == record) {
+        fprintf(stderr, "cannot open %s\n", db_name);
+        return 1;
+    }
+    printf("%s (%s engine, %s)\n", db_name, db_engine_name(db_p), durability_name(mode));
+
+    srand(1);
+    memset(record->data, 'x', max_size + 1);
+    start = clock_ns();
+    for (i = 0; i < n; i++) {
+        view_stamp vs = {.view_id = 1, .req_id = i + 1};
+        db_key_type key = vstol(&vs);
+        uint32_t size = min_size + (max_size > min_size ? rand() % (max_size - min_size + 1) : 0);
+        record->data_size = size + 1;
+        record->type = P_SEND;
+        record->clt_id = vs;
+        record->data[size] = '\0';
+
+        t = pace(start, i, rate);
+        if (store_record(db_p, sizeof(key), &key, REQ_RECORD_SIZE(record) - 1, record) != 0) {
+            fprintf(stderr, "put %u failed\n", i);
+            return 1;
+        }
+        if (DURABLE_BATCH == mode && 0 == (i + 1) % batch)
+            sync_db(db_p);
+        lat[i] = clock_ns() - t;
+        record->data[size] = 'x';
+    }
+    sync_db(db_p);
+    elapsed = clock_ns() - start;
+    report("put", lat, n, elapsed);
+
+    start = clock_ns();
+    for (i = 0; i < n; i++) {
+        view_stamp vs = {.view_id = 1, .req_id = (uint32_t)(rand() % n) + 1};
+        db_key_type key = vstol(&vs);
+        size_t data_size = 0;
+        void* data = NULL;
+
+        t = clock_ns();
+        if (retrieve_record(db_p, sizeof(key), &key, &data_size, &data) != 0 || NULL == data) {
+            fprintf(stderr, "get %u failed\n", vs.req_id);
+            return 1;
+        }
+        lat[i] = clock_ns() - t;
+        free(data);
+    }
+    elapsed = clock_ns() - start;
+    report("get", lat, n, elapsed);
+
+    db_stat_get(db_p, &stat);
+    printf("  %"PRIu64" syncs in %"PRIu64" flushes, flush mean %.1f us, max %.1f us\n", stat.syncs, stat.flushes,
+        stat.flushes ? stat.flush_ns / 1e3 / stat.flushes : 0.0, stat.max_flush_ns / 1e3);
+    close_db(db_p, 0);
+    free(record);
+    free(lat);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t n = 100000, min_size = 64, max_size = 1024, rate = 0, batch = 32;
+    durability mode = DURABLE_NONE;
+    int opt, rc = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:S:r:d:b:")) != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg); break;
+        case 's': min_size = atoi(optarg); break;
+        case 'S': max_size = atoi(optarg); break;
+        case 'r': rate = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'd':
+            if (durability_parse(optarg, &mode)) {
+                fprintf(stderr, "unknown durability %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (optind >= argc || n < 1 || batch < 1 || min_size > max_size)
+        goto usage;
+
+    printf("%u records of %u-%u bytes, ", n, min_size, max_size);
+    if (rate)
+        printf("%u puts/s offered\n\n", rate);
+    else
+        printf("unpaced\n\n");
+    for (; optind < argc; optind++) {
+        rc |= run(argv[optind], n, min_size, max_size, rate, mode, batch);
+        printf("\n");
+    }
+    return rc;
+
+usage:
+    fprintf(stderr, "usage: %s [-n records] [-s min_size] [-S max_size] [-r rate] [-d durability] [-b batch] db_name...\n", argv[0]);
+    return 1;
+}
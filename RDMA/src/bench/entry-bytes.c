@@ -0,0 +1,89 @@
+/* Bytes a leader puts on the wire per request, with the old log entry layout
+ * (acks inline in every entry) and the current one.
+ *
+ * usage: entry-bytes [group_size] [ack_group]
+ *   group_size  replicas, leader included (default 3)
+ *   ack_group   entries a follower acks at once (default 1)
+ */
+#include <stddef.h>
+#include "../include/rdma/dare_log.h"
+#include "../include/replica-sys/replica.h"
+
+FILE *log_fp;
+
+/* the layout before LOG_ENTRY_VERSION 2 */
+struct old_log_entry_t{
+    accept_ack ack[MAX_SERVER_COUNT];
+    view_stamp msg_vs;
+    view_stamp req_canbe_exed;
+    node_id_t node_id;
+    size_t data_size;
+    uint8_t type;
+    view_stamp clt_id;
+    char data[0];
+};
+struct old_request_record_t{
+    size_t data_size;
+    uint8_t type;
+    view_stamp clt_id;
+    char data[0];
+};
+
+/* InfiniBand RC RDMA write: LRH, BTH, ICRC and VCRC on every packet, RETH on the first */
+#define IB_MTU 4096
+#define IB_PACKET_HEADERS (8 + 12 + 4 + 2)
+#define IB_RETH 16
+
+static uint64_t wire_bytes(uint64_t len)
+{
+    uint64_t packets = (len + IB_MTU - 1) / IB_MTU;
+    if (packets == 0)
+        packets = 1;
+    return len + packets * IB_PACKET_HEADERS + IB_RETH;
+}
+
+/* one entry to every follower, and every follower's share of an ack */
+static double per_request(uint64_t entry_len, uint32_t followers, uint32_t ack_group)
+{
+    return (double)followers * wire_bytes(entry_len) + (double)followers * wire_bytes(ACCEPT_ACK_SIZE) / ack_group;
+}
+
+/* a P_BATCH entry of batch requests; the entry header is shared by all of them */
+static double per_batched_request(uint64_t header, uint64_t sub_header, uint64_t payload, uint32_t batch, uint32_t followers, uint32_t ack_group)
+{
+    uint64_t sub = (sub_header + payload + 7) & ~((uint64_t)7);
+    return per_request(header + sub * batch + 1, followers, ack_group) / batch;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t group_size = argc > 1 ? atoi(argv[1]) : 3;
+    uint32_t ack_group = argc > 2 ? atoi(argv[2]) : 1;
+    static const uint64_t payloads[] = {16, 64, 256, 1024, 4096};
+    uint32_t i, followers;
+
+    if (group_size < 2 || group_size > MAX_SERVER_COUNT || ack_group < 1) {
+        fprintf(stderr, "usage: %s [group_size 2-%d] [ack_group >= 1]\n", argv[0], MAX_SERVER_COUNT);
+        return 1;
+    }
+    followers = group_size - 1;
+
+    printf("entry header: %zu bytes before, %zu bytes now\n", sizeof(struct old_log_entry_t), sizeof(dare_log_entry_t));
+    printf("batch sub-record header: %zu bytes before, %zu bytes now\n",
+        offsetof(struct old_request_record_t, data), offsetof(request_record, data));
+    printf("%u replicas, one ack per %u entries, bytes on the wire per request\n\n", group_size, ack_group);
+
+    printf("%8s %12s %12s %8s %14s %14s %8s\n", "payload", "before", "now", "saved", "batch/before", "batch/now", "saved");
+    for (i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        uint64_t p = payloads[i];
+        double before = per_request(sizeof(struct old_log_entry_t) + p + 1, followers, ack_group);
+        double now = per_request(sizeof(dare_log_entry_t) + p + 1, followers, ack_group);
+        double batch_before = per_batched_request(sizeof(struct old_log_entry_t), offsetof(struct old_request_record_t, data), p, 16, followers, ack_group);
+        double batch_now = per_batched_request(sizeof(dare_log_entry_t), offsetof(request_record, data), p, 16, followers, ack_group);
+        printf("%8"PRIu64" %12.1f %12.1f %7.1f%% %14.1f %14.1f %7.1f%%\n", p,
+            before, now, 100.0 * (before - now) / before,
+            batch_before, batch_now, 100.0 * (batch_before - batch_now) / batch_before);
+    }
+    printf("\nbatch columns: P_BATCH entries of 16 requests\n");
+    return 0;
+}
@@ -20,6 +20,133 @@ int consensus_read_config(node* cur_node,const char* config_path){
 		goto goto_config_error;
 	}
 
+	cur_node->commit_durable = 0;
+
+	cur_node->batch.on = 0;
+	cur_node->batch.window_us = 50;
+	cur_node->batch.max_bytes = 64 * 1024;
+	cur_node->batch.max_count = 64;
+
+	cur_node->shard_count = 1;
+	cur_node->log_size = LOG_SIZE;
+	cur_node->log_file = NULL;
+	cur_node->log_sync_us = 1000;
+
+	cur_node->wait.mode = WAIT_SPIN;
+	cur_node->wait.spin_limit = 10000;
+	cur_node->wait.park_us = 100;
+
+	cur_node->placement.replica_core = 1;
+	cur_node->placement.completion_core = PLACE_ANY;
+	cur_node->placement.persistence_core = PLACE_ANY;
+	cur_node->placement.hb_core = PLACE_ANY;
+	cur_node->placement.checkpoint_core = PLACE_ANY;
+	cur_node->placement.log_numa_node = PLACE_NIC_NODE;
+
+	config_setting_t *global_config = NULL;
+	global_config = config_lookup(&config_file,"consensus_global_config");
+
+	if(NULL!=global_config){
+		int hb_on;
+		if(config_setting_lookup_int(global_config,"hb_on",&hb_on)){
+			cur_node->hb_on = hb_on;
+		}
+		config_setting_lookup_float(global_config,"hb_period",&cur_node->hb_period);
+		if(config_setting_lookup_float(global_config,"lease_ratio",&cur_node->lease_ratio)){
+			// a lease as long as the heartbeat timeout would outlive a new leader's election
+			if(cur_node->lease_ratio < 0 || cur_node->lease_ratio >= 1 - LEASE_DRIFT_MARGIN){
+				err_log("CONSENSUS : Lease Ratio Must Be At Least 0 And Below %.2f.\n",1 - LEASE_DRIFT_MARGIN);
+				goto goto_config_error;
+			}
+		}
+		const char* commit_rule;
+		if(config_setting_lookup_string(global_config,"commit_rule",&commit_rule)){
+			if(0==strcmp(commit_rule,"replicated")){
+				cur_node->commit_durable = 0;
+			}else if(0==strcmp(commit_rule,"durable")){
+				cur_node->commit_durable = 1;
+			}else{
+				err_log("CONSENSUS : Unknown Commit Rule %s.\n",commit_rule);
+				goto goto_config_error;
+			}
+		}
+		int batch_on, batch_window, batch_max_bytes, batch_max_count;
+		if(config_setting_lookup_int(global_config,"batch_on",&batch_on)){
+			cur_node->batch.on = batch_on;
+		}
+		if(config_setting_lookup_int(global_config,"batch_window",&batch_window)){
+			if(batch_window <= 0 || batch_window > BATCH_MAX_WINDOW_US){
+				err_log("CONSENSUS : Batch Window Must Be Between 1 And %d us.\n",BATCH_MAX_WINDOW_US);
+				goto goto_config_error;
+			}
+			cur_node->batch.window_us = batch_window;
+		}
+		if(config_setting_lookup_int(global_config,"batch_max_bytes",&batch_max_bytes)){
+			if(batch_max_bytes <= 0 || batch_max_bytes > BATCH_MAX_BYTES){
+				err_log("CONSENSUS : Batch Max Bytes Must Be Between 1 And %d.\n",BATCH_MAX_BYTES);
+				goto goto_config_error;
+			}
+			cur_node->batch.max_bytes = batch_max_bytes;
+		}
+		if(config_setting_lookup_int(global_config,"batch_max_count",&batch_max_count)){
+			if(batch_max_count <= 0 || batch_max_count > BATCH_MAX_COUNT){
+				err_log("CONSENSUS : Batch Max Count Must Be Between 1 And %d.\n",BATCH_MAX_COUNT);
+				goto goto_config_error;
+			}
+			cur_node->batch.max_count = batch_max_count;
+		}
+		int log_size_mb;
+		if(config_setting_lookup_int(global_config,"log_size_mb",&log_size_mb)){
+			if(log_size_mb <= 0){
+				err_log("CONSENSUS : Log Size Must Be Positive.\n");
+				goto goto_config_error;
+			}
+			cur_node->log_size = (uint64_t)log_size_mb << 20;
+		}
+		int log_sync_us;
+		if(config_setting_lookup_int(global_config,"log_sync_us",&log_sync_us)){
+			if(log_sync_us <= 0){
+				err_log("CONSENSUS : Log Sync Interval Must Be Positive.\n");
+				goto goto_config_error;
+			}
+			cur_node->log_sync_us = log_sync_us;
+		}
+		int shard_count;
+		if(config_setting_lookup_int(global_config,"shard_count",&shard_count)){
+			if(shard_count < 1 || shard_count > MAX_SHARD_COUNT){
+				err_log("CONSENSUS : Shard Count Must Be Between 1 And %d.\n",MAX_SHARD_COUNT);
+				goto goto_config_error;
+			}
+			cur_node->shard_count = shard_count;
+		}
+		const char* wait_strategy;
+		if(config_setting_lookup_string(global_config,"wait_strategy",&wait_strategy)){
+			if(wait_mode_parse(wait_strategy,&cur_node->wait.mode)){
+				err_log("CONSENSUS : Unknown Wait Strategy %s.\n",wait_strategy);
+				goto goto_config_error;
+			}
+		}
+		int spin_limit, park_us;
+		if(config_setting_lookup_int(global_config,"wait_spin_limit",&spin_limit)){
+			cur_node->wait.spin_limit = spin_limit;
+		}
+		if(config_setting_lookup_int(global_config,"wait_park_us",&park_us)){
+			cur_node->wait.park_us = park_us;
+		}
+	}
+
+	config_setting_t *placement_config = NULL;
+	placement_config = config_lookup(&config_file,"placement_config");
+
+	if(NULL!=placement_config){
+		config_setting_lookup_int(placement_config,"replica_core",&cur_node->placement.replica_core);
+		config_setting_lookup_int(placement_config,"completion_core",&cur_node->placement.completion_core);
+		config_setting_lookup_int(placement_config,"persistence_core",&cur_node->placement.persistence_core);
+		config_setting_lookup_int(placement_config,"hb_core",&cur_node->placement.hb_core);
+		config_setting_lookup_int(placement_config,"checkpoint_core",&cur_node->placement.checkpoint_core);
+		config_setting_lookup_int(placement_config,"log_numa_node",&cur_node->placement.log_numa_node);
+	}
+
 	config_setting_t *nodes_config;
 	nodes_config = config_lookup(&config_file,"consensus_config");
 
@@ -60,6 +187,10 @@ int consensus_read_config(node* cur_node,const char* config_path){
 		goto goto_config_error;
 	}
 	cur_node->db_name[db_name_len] = '\0';
+	const char* log_file;
+	if(config_setting_lookup_string(node_config,"log_file",&log_file) && log_file[0] != '\0'){
+		cur_node->log_file = strdup(log_file);
+	}
 	
 	config_destroy(&config_file);
 
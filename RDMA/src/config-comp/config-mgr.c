@@ -20,6 +20,8 @@ int mgr_read_config(struct event_manager_t* cur_node,const char* config_path){
         goto goto_config_error;
     }
 
+    cur_node->durability = DURABLE_ASYNC;
+
     config_setting_t *mgr_global_config = NULL;
     mgr_global_config = config_lookup(&config_file,"mgr_global_config");
     
@@ -32,6 +34,60 @@ int mgr_read_config(struct event_manager_t* cur_node,const char* config_path){
         if(config_setting_lookup_int(mgr_global_config,"check_output",&check_output)){
             cur_node->check_output = check_output;
         }
+        int output_hasher;
+        if(config_setting_lookup_int(mgr_global_config,"output_hasher",&output_hasher)){
+            cur_node->output_hasher = output_hasher;
+        }
+        int output_window;
+        if(config_setting_lookup_int(mgr_global_config,"output_window",&output_window)){
+            if(output_window <= CHECK_GOBACK){
+                err_log("EVENT MANAGER : Output Window Must Exceed %d.\n",CHECK_GOBACK);
+                goto goto_config_error;
+            }
+            set_output_window(output_window);
+        }
+        check_policy policy;
+        get_check_policy(&policy);
+        int check_period;
+        if(config_setting_lookup_int(mgr_global_config,"check_min_period",&check_period)){
+            policy.min_period = check_period;
+        }
+        if(config_setting_lookup_int(mgr_global_config,"check_max_period",&check_period)){
+            policy.max_period = check_period;
+        }
+        int check_backoff_after;
+        if(config_setting_lookup_int(mgr_global_config,"check_backoff_after",&check_backoff_after)){
+            policy.backoff_after = check_backoff_after;
+        }
+        config_setting_lookup_float(mgr_global_config,"check_max_share",&policy.max_share);
+        if(set_check_policy(&policy)){
+            err_log("EVENT MANAGER : Invalid Output Check Policy.\n");
+            goto goto_config_error;
+        }
+        int async_rsm;
+        if(config_setting_lookup_int(mgr_global_config,"async_rsm",&async_rsm)){
+            cur_node->async_rsm = async_rsm;
+        }
+        const char* level;
+        if(config_setting_lookup_string(mgr_global_config,"durability",&level)){
+            if(durability_parse(level,&cur_node->durability)){
+                err_log("EVENT MANAGER : Unknown Durability %s.\n",level);
+                goto goto_config_error;
+            }
+        }
+        const char* classifier_name;
+        if(config_setting_lookup_string(mgr_global_config,"classifier",&classifier_name) && 0!=strcmp(classifier_name,"none")){
+            cur_node->classifier = find_classifier(classifier_name);
+            if(NULL==cur_node->classifier){
+                err_log("EVENT MANAGER : Unknown Request Classifier %s.\n",classifier_name);
+                goto goto_config_error;
+            }
+            if(cur_node->check_output){
+                // followers must produce the same output, so every request is replicated
+                err_log("EVENT MANAGER : Local Reads Are Disabled When Output Is Checked.\n");
+                cur_node->classifier = NULL;
+            }
+        }
     }
 
     config_setting_t *mgr_config = NULL;
@@ -6,13 +6,30 @@
 #include "../include/rdma/dare_server.h"
 #include "../include/util/clock.h"
 
+#include <semaphore.h>
+#include <sys/eventfd.h>
+
 #define IBDEV dare_ib_device
 #define SRV_DATA ((dare_server_data_t*)dare_ib_device->udata)
+// this instance's part of the log region, and its offset in the remote region
+#define COMP_LOG(comp) log_shard(SRV_DATA->log, (comp)->shard)
+#define COMP_LOG_OFFSET(comp) log_shard_offset(SRV_DATA->log, (comp)->shard)
 
 #define USE_SPIN_LOCK
 //#define MEASURE_LATENCY
 
 #define DUMMY_END 'f'
+// most entries a follower accepts before sending one cumulative ack
+#define ACK_GROUP_MAX 64
+// type of the marker telling followers that the next entry starts at offset 0
+#define WRAP_MARK 0xff
+// a follower tells the leader how far it has read once it is this far behind (log->len >> READ_PUBLISH_SHIFT)
+#define READ_PUBLISH_SHIFT 4
+// idle rounds of the replica thread between two looks at the clock for stat reports
+#define WAIT_REPORT_ROUNDS 1024
+
+_Static_assert(offsetof(dare_log_entry_t, data) - offsetof(dare_log_entry_t, data_size) == offsetof(request_record, data),
+    "the tail of a log entry must be a request_record");
 
 typedef enum request_type_t{
 	P_TCP_CONNECT=1,
@@ -21,10 +38,70 @@ typedef enum request_type_t{
 	P_OUTPUT=4,
 	P_NOP=5,
     P_UDP_CONNECT=6,
+    P_BATCH=7,
 }request_type;
 
+typedef struct proposal_batch_t{
+    struct proposal_batch_t* next;  // in the pool
+    char* buf;                      // batch_cfg.max_bytes, kept across reuses
+    size_t bytes;
+    uint32_t count;
+    uint64_t opened_ns;
+    int refs;               // synchronous proposers, the flusher, and one for the async tickets
+    volatile int writers;   // sub-records reserved but still being copied in
+    volatile int sealed;
+    volatile int done;
+    doorbell bell;          // rings on the last writer and on done
+    dare_log_entry_t* entry;
+    struct consensus_component_t* comp;
+    rsm_ticket ticket;      // of the P_BATCH entry, if async sub-records wait for it
+    rsm_ticket* subs;       // tickets of the async sub-records
+    rsm_ticket** subs_tail;
+}proposal_batch;
+
+// batches allocated up front; more are made if that many are in flight
+#define BATCH_POOL_SIZE 8
+
+#define COMMIT_RING_SIZE 4096
+
+/* per-proposal quorum state on the leader, indexed by req_id */
+typedef struct commit_slot_t{
+    volatile req_id_t req_id;   // proposal occupying this slot
+    view_stamp vs;
+    dare_log_entry_t* entry;
+    rsm_ticket* ticket;
+}commit_slot;
+
+/* an entry waiting for the persistence thread, indexed by req_id */
+typedef struct persist_slot_t{
+    volatile req_id_t req_id;
+    view_stamp vs;
+    dare_log_entry_t* entry;
+    uint64_t end;   // log byte counter after the entry
+}persist_slot;
+
+#define PERSIST_RING_SIZE 8192
+
+/* stored with the records, under commit_point_key(), as the persistence
+ * thread goes; everything up to committed was applied (or, on the leader,
+ * committed) before the store last saw it */
+typedef struct commit_point_t{
+    view_stamp committed;
+}commit_point;
+
+/* where an accepted entry sits in the log, indexed by req_id */
+typedef struct entry_slot_t{
+    view_stamp vs;
+    uint64_t pos;   // byte counter of the entry, as in read and accepted
+}entry_slot;
+
+// the leader keeps fewer than COMMIT_RING_SIZE proposals uncommitted, so a
+// follower never has more unapplied entries than this
+#define ENTRY_INDEX_SIZE (2 * COMMIT_RING_SIZE)
+
 typedef struct consensus_component_t{ con_role my_role;
     uint32_t* node_id;
+    uint32_t shard;
 
     uint32_t group_size;
     struct node_t* my_node;
@@ -47,9 +124,73 @@ typedef struct consensus_component_t{ con_role my_role;
     up_check uc;
     up_get ug;
     void* up_para;
+
+    batch_config batch_cfg;
+    proposal_batch* open_batch;
+    proposal_batch* batch_pool;         // free batches, under batch_lock
+    volatile int batch_joining;         // batchable proposals not yet added to a batch
+    pthread_spinlock_t batch_lock;
+    wait_stat batch_wait;
+
+    // commit sequencer; whoever holds commit_lock advances highest_committed_vs
+    commit_slot commit_ring[COMMIT_RING_SIZE];
+    req_id_t acked[MAX_SERVER_COUNT];   // highest req_id acked by each follower
+    pthread_spinlock_t commit_lock;
+    // committed asynchronous proposals not yet handed back, in log order
+    rsm_ticket* done_head;
+    rsm_ticket* done_tail;
+    volatile int async_pending;
+    sem_t async_sem;
+    int completion_fd;
+
+    // how idle loops wait; commit_bell rings whenever the commit point moves
+    wait_config wait_cfg;
+    doorbell commit_bell;
+    wait_stat accept_wait;
+    wait_stat propose_wait;             // proposers waiting for room in the log or the commit ring
+    wait_stat commit_wait;
+    wait_stat completion_wait;
+    uint32_t idle_rounds;
+    uint64_t next_report;
+    uint64_t published_read;    // follower: last read counter sent to the leader
+    entry_slot entry_index[ENTRY_INDEX_SIZE];   // follower: accepted entries, for apply
+
+    // persistence pipeline; entries stay in the log until they are durable
+    persist_slot persist_ring[PERSIST_RING_SIZE];
+    volatile req_id_t persist_next;     // next req_id the persistence thread takes
+    volatile int persist_resync;        // follower restarted; the first entry may be past persist_next
+    doorbell persist_bell;              // rings whenever persist_next moves
+    wait_stat persist_full_wait;        // proposers waiting for room in persist_ring
+    view_stamp durable_vs;              // every entry up to here is durable
+    volatile uint64_t durable_pos;      // log byte counter after the last durable entry
+    req_id_t durable_acked[MAX_SERVER_COUNT];   // highest req_id durable on each follower
+    view_stamp acked_durable;           // follower: durable point last sent to the leader
+    int commit_durable;                 // commit once durable on a majority, not once replicated
+    durability durability;              // of the db, which a file-backed log follows as well
+    wait_stat persist_wait;
+    db_stat persist_stat;               // one flush per batch the persistence thread takes
+    view_stamp stored_point;            // commit point last handed to the db
 }consensus_component;
 
-consensus_component* init_consensus_comp(struct node_t* node,uint32_t* node_id,FILE* log,int sys_log,int stat_log,const char* db_name,void* db_ptr,int group_size,
+/* A batch with a buffer of batch_cfg.max_bytes; NULL if out of memory */
+static proposal_batch* batch_new(consensus_component* comp)
+{
+    proposal_batch* b = (proposal_batch*)malloc(sizeof(proposal_batch));
+    if (NULL == b)
+        return NULL;
+    memset(b, 0, sizeof(proposal_batch));
+    b->buf = (char*)malloc(comp->batch_cfg.max_bytes);
+    if (NULL == b->buf) {
+        free(b);
+        return NULL;
+    }
+    doorbell_init(&b->bell);
+    b->comp = comp;
+    b->subs_tail = &b->subs;
+    return b;
+}
+
+consensus_component* init_consensus_comp(struct node_t* node,uint32_t shard,uint32_t* node_id,FILE* log,int sys_log,int stat_log,const char* db_name,void* db_ptr,int group_size,
     view* cur_view,view_stamp* to_commit,view_stamp* highest_committed_vs,view_stamp* highest,user_cb u_cb,up_check uc,up_get ug,void* arg){
     consensus_component* comp = (consensus_component*)malloc(sizeof(consensus_component));
     memset(comp,0,sizeof(consensus_component));
@@ -61,6 +202,7 @@ consensus_component* init_consensus_comp(struct node_t* node,uint32_t* node_id,F
         comp->sys_log_file = log;
         comp->my_node = node;
         comp->node_id = node_id;
+        comp->shard = shard;
         comp->group_size = group_size;
         comp->cur_view = cur_view;
         if(comp->cur_view->leader_id == *comp->node_id){
@@ -73,15 +215,46 @@ consensus_component* init_consensus_comp(struct node_t* node,uint32_t* node_id,F
         comp->ug = ug;
         comp->up_para = arg;
         comp->highest_seen_vs = highest;
-        comp->highest_seen_vs->view_id = 1;
+        comp->highest_seen_vs->view_id = 1 | SHARD_VIEW_BITS(shard);
         comp->highest_seen_vs->req_id = 0;
         comp->highest_committed_vs = highest_committed_vs; 
-        comp->highest_committed_vs->view_id = 1; 
+        comp->highest_committed_vs->view_id = 1 | SHARD_VIEW_BITS(shard);
         comp->highest_committed_vs->req_id = 0; 
         comp->highest_to_commit_vs = to_commit;
-        comp->highest_to_commit_vs->view_id = 1;
+        comp->highest_to_commit_vs->view_id = 1 | SHARD_VIEW_BITS(shard);
         comp->highest_to_commit_vs->req_id = 0;
 
+        comp->batch_cfg = node->batch;
+        comp->open_batch = NULL;
+        comp->batch_pool = NULL;
+        pthread_spin_init(&comp->batch_lock, PTHREAD_PROCESS_PRIVATE);
+        if (comp->batch_cfg.on) {
+            int i;
+            for (i = 0; i < BATCH_POOL_SIZE; i++) {
+                proposal_batch* b = batch_new(comp);
+                if (NULL == b)
+                    break;
+                b->next = comp->batch_pool;
+                comp->batch_pool = b;
+            }
+        }
+
+        pthread_spin_init(&comp->commit_lock, PTHREAD_PROCESS_PRIVATE);
+        comp->done_head = comp->done_tail = NULL;
+        comp->async_pending = 0;
+        sem_init(&comp->async_sem, 0, 0);
+        comp->completion_fd = -1;
+
+        comp->wait_cfg = node->wait;
+        doorbell_init(&comp->commit_bell);
+
+        comp->persist_next = 1;
+        doorbell_init(&comp->persist_bell);
+        comp->durable_vs.view_id = 1 | SHARD_VIEW_BITS(shard);
+        comp->durable_vs.req_id = 0;
+        comp->commit_durable = node->commit_durable;
+        comp->durability = db_durability(comp->db_ptr);
+
 #ifdef USE_SPIN_LOCK
         pthread_spin_init(&comp->spinlock, PTHREAD_PROCESS_PRIVATE);
 #else
@@ -112,20 +285,268 @@ static int reached_quorum(uint64_t bit_map, int group_size){
     }
 }
 
-dare_log_entry_t* leader_handle_submit_req(struct consensus_component_t* comp, size_t data_size, void* data, uint8_t type, view_stamp* clt_id)
+static uint64_t now_ns()
 {
-#ifdef MEASURE_LATENCY
-        clock_handler c_k;
-        clock_init(&c_k);
-        clock_add(&c_k);
-#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int is_batchable(consensus_component* comp, size_t data_size, uint8_t type)
+{
+    if (!comp->batch_cfg.on || type != P_SEND)
+        return 0;
+    return offsetof(request_record, data) + data_size + 7 <= comp->batch_cfg.max_bytes;
+}
+
+/* Takes a batch from the pool, or makes one; called under batch_lock */
+static proposal_batch* batch_get(consensus_component* comp)
+{
+    proposal_batch* b = comp->batch_pool;
+    if (NULL == b)
+        return batch_new(comp);
+    comp->batch_pool = b->next;
+    b->next = NULL;
+    b->bytes = 0;
+    b->count = 0;
+    b->refs = 0;
+    b->writers = 0;
+    b->sealed = 0;
+    b->done = 0;
+    b->entry = NULL;
+    b->subs = NULL;
+    b->subs_tail = &b->subs;
+    return b;
+}
+
+/* Followers ack a whole group of entries at once, so an ack for req_id r
+ * covers every proposal up to r. Each follower keeps its newest ack in its
+ * own slot of the ack area. */
+static void refresh_acks(consensus_component* comp)
+{
+    dare_log_t* log = COMP_LOG(comp);
+    uint32_t i, my_id = *comp->node_id;
+
+    for (i = 0; i < comp->group_size; i++) {
+        if (i == my_id)
+            continue;
+        view_stamp vs = log->ctrl_data.ack[i].last.msg_vs;
+        if (vs.view_id == comp->highest_seen_vs->view_id && vs.req_id > comp->acked[i])
+            comp->acked[i] = vs.req_id;
+        vs = log->ctrl_data.ack[i].last.durable;
+        if (vs.view_id == comp->highest_seen_vs->view_id && vs.req_id > comp->durable_acked[i])
+            comp->durable_acked[i] = vs.req_id;
+    }
+}
+
+static int slot_reached_quorum(consensus_component* comp, req_id_t req_id)
+{
+    uint32_t i;
+    uint64_t bit_map = 0;
+    if (!comp->commit_durable || comp->durable_vs.req_id >= req_id)
+        bit_map = (1<<*comp->node_id);
+    for (i = 0; i < comp->group_size; i++) {
+        req_id_t acked = comp->commit_durable ? comp->durable_acked[i] : comp->acked[i];
+        if (acked >= req_id)
+            bit_map = bit_map | (1<<i);
+    }
+    return reached_quorum(bit_map, comp->group_size);
+}
+
+/* Commits the contiguous prefix of proposals that reached quorum. Only one
+ * thread advances at a time; the others simply find their slot covered later. */
+static void commit_advance(consensus_component* comp)
+{
+    if (pthread_spin_trylock(&comp->commit_lock) != 0)
+        return;
+
+    req_id_t committed = comp->highest_committed_vs->req_id;
+
+    for (;;) {
+        req_id_t next = comp->highest_committed_vs->req_id + 1;
+        commit_slot* slot = &comp->commit_ring[next & (COMMIT_RING_SIZE - 1)];
+        if (slot->req_id != next)
+            break;
+        if (!slot_reached_quorum(comp, next)) {
+            refresh_acks(comp);
+            if (!slot_reached_quorum(comp, next))
+                break;
+        }
+
+        if (NULL != slot->ticket) {
+            slot->ticket->next = NULL;
+            if (NULL == comp->done_tail)
+                comp->done_head = slot->ticket;
+            else
+                comp->done_tail->next = slot->ticket;
+            comp->done_tail = slot->ticket;
+            slot->ticket = NULL;
+        }
+        comp->highest_committed_vs->req_id = next;
+    }
+
+    pthread_spin_unlock(&comp->commit_lock);
+
+    if (comp->highest_committed_vs->req_id != committed)
+        doorbell_ring(&comp->commit_bell);
+}
+
+/* RDMA-writes len bytes of the local log region to offset in server's region */
+static void post_log_write(uint32_t server, void* buf, uint32_t len, uint64_t offset)
+{
+    dare_ib_ep_t *ep = (dare_ib_ep_t*)SRV_DATA->config.servers[server].ep;
+    rem_mem_t rm;
+    memset(&rm, 0, sizeof(rem_mem_t));
+
+    // the QP is shared by every shard
+    uint32_t send_count = __sync_fetch_and_add(&ep->rc_ep.rc_qp.send_count, 1);
+    int send_flags, poll_completion = 0;
+
+    if((send_count & S_DEPTH_) == 0)
+        send_flags = IBV_SEND_SIGNALED;
+    else
+        send_flags = 0;
+
+    if ((send_count & S_DEPTH_) == S_DEPTH_)
+        poll_completion = 1;
+
+    rm.raddr = ep->rc_ep.rmt_mr.raddr + offset;
+    rm.rkey = ep->rc_ep.rmt_mr.rkey;
+
+    post_send(server, buf, len, IBDEV->lcl_mr, IBV_WR_RDMA_WRITE, &rm, send_flags, poll_completion);
+}
+
+/* Hands an entry to the persistence thread; end is the log byte counter
+ * after it. Entries may come in any order, the thread takes them by req_id. */
+static void persist_enqueue(consensus_component* comp, dare_log_entry_t* entry, uint64_t end)
+{
+    req_id_t r = entry->msg_vs.req_id;
+    waiter w;
+    // only a follower gets here with the flag set, in log order; a leader
+    // clears it under the proposal lock, as it numbers from persist_next
+    if (comp->persist_resync && __sync_bool_compare_and_swap(&comp->persist_resync, 1, 0)) {
+        // the leader resumed past this node's commit point; the earlier run
+        // stored the records in between
+        if (r > comp->persist_next) {
+            comp->persist_next = r;
+            doorbell_ring(&comp->persist_bell);
+        }
+    }
+    // the ring is full; wait for the disk
+    waiter_init(&w, &comp->wait_cfg, &comp->persist_bell, &comp->persist_full_wait);
+    while (r - comp->persist_next >= PERSIST_RING_SIZE)
+        waiter_idle(&w);
+    waiter_busy(&w);
+
+    persist_slot* slot = &comp->persist_ring[r & (PERSIST_RING_SIZE - 1)];
+    slot->vs = entry->msg_vs;
+    slot->entry = entry;
+    slot->end = end;
+    __sync_synchronize();
+    slot->req_id = r;
+}
+
+/* Space behind head has been read by every connected follower and may be
+ * written again. Followers that are not connected do not hold it back. */
+static void refresh_log_head(consensus_component* comp, dare_log_t* log)
+{
+    uint32_t i;
+    uint64_t head = log->write;
+    for (i = 0; i < comp->group_size; i++) {
+        dare_ib_ep_t *ep = (dare_ib_ep_t*)SRV_DATA->config.servers[i].ep;
+        if (i == *SRV_DATA->config.idx || 0 == ep->rc_connected)
+            continue;
+        if (log->ctrl_data.read[i] < head)
+            head = log->ctrl_data.read[i];
+    }
+    // our own entries are overwritten only once they are durable
+    if (comp->durable_pos < head)
+        head = comp->durable_pos;
+    if (head > log->head)
+        log->head = head;
+}
+
+/* Whether a proposal of need bytes fits in the log and in the commit ring
+ * right now; called under the proposal lock. skip is set to the bytes left
+ * at the end of the buffer if the entry has to go to the start. */
+static int propose_has_room(consensus_component* comp, dare_log_t* log, uint64_t need, uint64_t* skip)
+{
+    *skip = (log->end + need > log->len) ? log->len - log->end : 0;
+    if (log->write + *skip + need - log->head > log->len) {
+        refresh_log_head(comp, log);
+        if (log->write + *skip + need - log->head > log->len)
+            return 0;
+    }
+    return comp->highest_seen_vs->req_id + 1 - comp->highest_committed_vs->req_id <= COMMIT_RING_SIZE;
+}
 
+/* Appends a new entry to the log, claims its commit slot and posts it to
+ * every connected follower. */
+static int leader_propose(consensus_component* comp, size_t data_size, void* data, uint8_t type, view_stamp* clt_id, rsm_ticket* ticket, dare_log_entry_t** entry_ptr)
+{
+        dare_log_t* log = COMP_LOG(comp);
+        uint64_t need = sizeof(dare_log_entry_t) + data_size + 1;
+        if (need > log->len) {
+            fprintf(stderr, "CONSENSUS : a %zu byte request does not fit in the log\n", data_size);
+            return 1;
+        }
 
+        /* A full log or commit ring is waited out without the proposal lock,
+         * helping the sequencer meanwhile; a follower that stays behind makes
+         * the proposal fail after PROPOSE_TIMEOUT_NS */
+        uint64_t at, skip, deadline = 0;
+        waiter w;
+        waiter_init(&w, &comp->wait_cfg, &comp->commit_bell, &comp->propose_wait);
+        for (;;) {
+#ifdef USE_SPIN_LOCK
+            pthread_spin_lock(&comp->spinlock);
+#else
+            pthread_mutex_lock(&comp->lock);
+#endif
+            if (propose_has_room(comp, log, need, &skip))
+                break;
 #ifdef USE_SPIN_LOCK
-        pthread_spin_lock(&comp->spinlock);
+            pthread_spin_unlock(&comp->spinlock);
 #else
-        pthread_mutex_lock(&comp->lock);
+            pthread_mutex_unlock(&comp->lock);
 #endif
+            if (0 == deadline) {
+                deadline = now_ns() + PROPOSE_TIMEOUT_NS;
+            } else if (now_ns() >= deadline) {
+                waiter_busy(&w);
+                fprintf(stderr, "CONSENSUS : shard %"PRIu32" log or commit ring is full, a proposal fails\n", comp->shard);
+                return 1;
+            }
+            commit_advance(comp);
+            waiter_idle(&w);
+        }
+        waiter_busy(&w);
+        // proposals number on from persist_next, so there is nothing to resync
+        if (comp->persist_resync)
+            __sync_bool_compare_and_swap(&comp->persist_resync, 1, 0);
+
+        // with skip, there is no room before the end of the buffer and the entry goes to the start
+        at = (skip > 0) ? 0 : log->end;
+
+        dare_ib_ep_t *ep;
+        uint32_t i, send_count;
+        if (skip > 0 && log_fit_entry_header(log, log->end)) {
+            dare_log_entry_t* mark = (dare_log_entry_t*)(log->entries + log->end);
+            mark->version = LOG_ENTRY_VERSION;
+            mark->data_size = 1;
+            mark->type = WRAP_MARK;
+            mark->data[0] = DUMMY_END;
+            for (i = 0; i < comp->group_size; i++) {
+                ep = (dare_ib_ep_t*)SRV_DATA->config.servers[i].ep;
+                if (i == *SRV_DATA->config.idx || 0 == ep->rc_connected)
+                    continue;
+                post_log_write(i, mark, log_entry_len(mark), COMP_LOG_OFFSET(comp) + offsetof(dare_log_t, entries) + log->end);
+            }
+        }
+        log->write += skip + need;
+        log->tail = at;
+        log->end = at + need;
+        uint64_t entry_end = log->write;
 
         view_stamp next = get_next_view_stamp(comp);
 
@@ -135,75 +556,71 @@ dare_log_entry_t* leader_handle_submit_req(struct consensus_component_t* comp, s
             clt_id->req_id = next.req_id;
         }
 
-        db_key_type record_no = vstol(&next);
-
         comp->highest_seen_vs->req_id = comp->highest_seen_vs->req_id + 1;
 
-        dare_log_entry_t *entry = log_add_new_entry(SRV_DATA->log);
-
-        if (!log_fit_entry_header(SRV_DATA->log, SRV_DATA->log->end)) {
-            SRV_DATA->log->end = 0;
-        }
-
-        SRV_DATA->log->tail = SRV_DATA->log->end;
+        dare_log_entry_t *entry = (dare_log_entry_t*)(log->entries + at);
         entry->data_size = data_size + 1;
-        SRV_DATA->log->end += log_entry_len(entry);
-        uint32_t offset = (uint32_t)(offsetof(dare_log_t, entries) + SRV_DATA->log->tail);
+        uint64_t offset = COMP_LOG_OFFSET(comp) + offsetof(dare_log_t, entries) + at;
 
-        dare_ib_ep_t *ep;
-        uint32_t i, *send_count_ptr;
         int send_flags[MAX_SERVER_COUNT], poll_completion[MAX_SERVER_COUNT] = {0};
         for (i = 0; i < comp->group_size; i++) {
             ep = (dare_ib_ep_t*)SRV_DATA->config.servers[i].ep;
             if (i == *SRV_DATA->config.idx || 0 == ep->rc_connected)
                 continue;
-            send_count_ptr = &(ep->rc_ep.rc_qp.send_count);
+            // the QP is shared by every shard
+            send_count = __sync_fetch_and_add(&ep->rc_ep.rc_qp.send_count, 1);
 
-            if((*send_count_ptr & S_DEPTH_) == 0)
+            if((send_count & S_DEPTH_) == 0)
                 send_flags[i] = IBV_SEND_SIGNALED;
             else
                 send_flags[i] = 0;
 
-            if ((*send_count_ptr & S_DEPTH_) == S_DEPTH_)
+            if ((send_count & S_DEPTH_) == S_DEPTH_)
                 poll_completion[i] = 1;
-            
-            (*send_count_ptr)++;
         }
 
+        if (ticket != NULL) {
+            ticket->vs = next;
+            ticket->entry = entry;
+            ticket->done = 0;
+            ticket->next = NULL;
+        }
+        commit_slot* slot = &comp->commit_ring[next.req_id & (COMMIT_RING_SIZE - 1)];
+        slot->vs = next;
+        slot->entry = entry;
+        slot->ticket = ticket;
+        __sync_synchronize();
+        slot->req_id = next.req_id;
+
 #ifdef USE_SPIN_LOCK
         pthread_spin_unlock(&comp->spinlock);
 #else
         pthread_mutex_unlock(&comp->lock);
 #endif
 
+        if (ticket != NULL && __sync_fetch_and_add(&comp->async_pending, 1) == 0)
+            sem_post(&comp->async_sem);
+
+        *entry_ptr = entry;
+
         entry->req_canbe_exed.view_id = comp->highest_committed_vs->view_id;
         entry->req_canbe_exed.req_id = comp->highest_committed_vs->req_id;
         
         if (data != NULL)
             memcpy(entry->data,data,data_size);
 
+        entry->version = LOG_ENTRY_VERSION;
         entry->msg_vs = next;
         entry->node_id = *comp->node_id;
         entry->type = type;
         entry->clt_id.view_id = (type != P_NOP)?clt_id->view_id:0;
         entry->clt_id.req_id = (type != P_NOP)?clt_id->req_id:0;
 
-        request_record* record_data = (request_record*)((char*)entry + offsetof(dare_log_entry_t, data_size));
+        persist_enqueue(comp, entry, entry_end);
 
-        if(store_record(comp->db_ptr, sizeof(record_no), &record_no, REQ_RECORD_SIZE(record_data) - 1, record_data))
-        {
-            fprintf(stderr, "Can not save record from database.\n");
-            goto handle_submit_req_exit;
-        }
-
-#ifdef MEASURE_LATENCY
-        clock_add(&c_k);
-#endif
         char* dummy = (char*)((char*)entry + log_entry_len(entry) - 1);
         *dummy = DUMMY_END;
 
-        uint32_t my_id = *comp->node_id;
-        uint64_t bit_map = (1<<my_id);
         rem_mem_t rm;
         memset(&rm, 0, sizeof(rem_mem_t));
         for (i = 0; i < comp->group_size; i++) {
@@ -216,150 +633,761 @@ dare_log_entry_t* leader_handle_submit_req(struct consensus_component_t* comp, s
 
             post_send(i, entry, log_entry_len(entry), IBDEV->lcl_mr, IBV_WR_RDMA_WRITE, &rm, send_flags[i], poll_completion[i]);
         }
+        return 0;
+}
 
-recheck:
-        for (i = 0; i < MAX_SERVER_COUNT; i++) {
-            if (entry->ack[i].msg_vs.view_id == next.view_id && entry->ack[i].msg_vs.req_id == next.req_id)
-            {
-                bit_map = bit_map | (1<<entry->ack[i].node_id);
-            }
+static void wait_committed(consensus_component* comp, dare_log_entry_t* entry)
+{
+    waiter w;
+    waiter_init(&w, &comp->wait_cfg, &comp->commit_bell, &comp->commit_wait);
+    for (;;) {
+        commit_advance(comp);
+        if (comp->highest_committed_vs->req_id >= entry->msg_vs.req_id)
+            break;
+        waiter_idle(&w);
+    }
+    waiter_busy(&w);
+}
+
+static void batch_release(consensus_component* comp, proposal_batch* b)
+{
+    pthread_spin_lock(&comp->batch_lock);
+    if (--b->refs == 0) {
+        b->next = comp->batch_pool;
+        comp->batch_pool = b;
+    }
+    pthread_spin_unlock(&comp->batch_lock);
+}
+
+/* The P_BATCH entry committed, or could not be proposed (ticket->entry is
+ * NULL then); hands every async sub-record's ticket back. */
+static void batch_done(rsm_ticket* ticket, void* arg)
+{
+    proposal_batch* b = arg;
+    rsm_ticket *t, *next;
+    for (t = b->subs; NULL != t; t = next) {
+        next = t->next;
+        t->vs = ticket->vs;
+        t->entry = ticket->entry;
+        rsm_done_cb cb = t->cb;
+        void* cb_arg = t->cb_arg;
+        t->done = 1;
+        if (NULL != cb)
+            cb(t, cb_arg);
+    }
+    batch_release(b->comp, b);
+}
+
+/* Replicates a sealed batch once its sub-records are copied in; the caller
+ * holds a reference for the flush. */
+static void batch_flush(consensus_component* comp, proposal_batch* b)
+{
+    waiter w;
+    waiter_init(&w, &comp->wait_cfg, &b->bell, &comp->batch_wait);
+    while (b->writers != 0)
+        waiter_idle(&w);
+    waiter_busy(&w);
+
+    rsm_ticket* ticket = NULL;
+    if (NULL != b->subs) {
+        ticket = &b->ticket;
+        memset(ticket, 0, sizeof(rsm_ticket));
+        ticket->cb = batch_done;
+        ticket->cb_arg = b;
+    }
+    view_stamp batch_id = {0, 0};
+    dare_log_entry_t* entry = NULL;
+    if (leader_propose(comp, b->bytes, b->buf, P_BATCH, &batch_id, ticket, &entry)) {
+        entry = NULL;
+        if (NULL != ticket)
+            batch_done(ticket, b);
+    }
+    b->entry = entry;
+    b->done = 1;
+    doorbell_ring(&b->bell);
+    batch_release(comp, b);
+}
+
+/* Concurrent P_SEND proposals, synchronous or not, are packed as sub-records
+ * into one P_BATCH entry. A batch is sealed once it is full, once it is
+ * batch_window old, or once no other batchable proposal is on its way in, so
+ * a lone proposal goes out at once; whoever seals it replicates it. A
+ * synchronous proposal returns once the batch commits, an async one at once,
+ * its ticket firing with the batch's. */
+static int batch_submit(consensus_component* comp, size_t data_size, void* data, view_stamp* clt_id, rsm_ticket* ticket, dare_log_entry_t** entry_ptr)
+{
+    proposal_batch *b, *full = NULL, *flush = NULL;
+    size_t sub_size = (offsetof(request_record, data) + data_size + 7) & ~((size_t)7);
+
+    __sync_fetch_and_add(&comp->batch_joining, 1);
+    pthread_spin_lock(&comp->batch_lock);
+    b = comp->open_batch;
+    if (b != NULL && b->bytes + sub_size > comp->batch_cfg.max_bytes) {
+        /* no room left; replicate it and open a new one */
+        b->sealed = 1;
+        b->refs++;
+        full = b;
+        comp->open_batch = NULL;
+        b = NULL;
+    }
+    if (b == NULL) {
+        b = batch_get(comp);
+        if (NULL == b) {
+            __sync_fetch_and_sub(&comp->batch_joining, 1);
+            pthread_spin_unlock(&comp->batch_lock);
+            if (NULL != full)
+                batch_flush(comp, full);
+            return 1;
         }
-        if (reached_quorum(bit_map, comp->group_size)) {
-            //TODO: do we need the lock here?
-            while (entry->msg_vs.req_id > comp->highest_committed_vs->req_id + 1);
-            comp->highest_committed_vs->req_id = comp->highest_committed_vs->req_id + 1;
-            
+        b->opened_ns = now_ns();
+        comp->open_batch = b;
+    }
+    request_record* sub = (request_record*)(b->buf + b->bytes);
+    b->bytes += sub_size;
+    b->count++;
+    b->writers++;
+    if (NULL != ticket) {
+        if (NULL == b->subs)
+            b->refs++;
+        ticket->next = NULL;
+        ticket->done = 0;
+        *b->subs_tail = ticket;
+        b->subs_tail = &ticket->next;
+    } else {
+        b->refs++;
+    }
+    if (0 == __sync_sub_and_fetch(&comp->batch_joining, 1)
+        || b->count >= comp->batch_cfg.max_count || b->bytes >= comp->batch_cfg.max_bytes
+        || now_ns() - b->opened_ns >= (uint64_t)comp->batch_cfg.window_us * 1000) {
+        b->sealed = 1;
+        b->refs++;
+        flush = b;
+        comp->open_batch = NULL;
+    }
+    pthread_spin_unlock(&comp->batch_lock);
+
+    sub->data_size = data_size + 1;
+    sub->type = P_SEND;
+    sub->clt_id = *clt_id;
+    memcpy(sub->data, data, data_size);
+    if (1 == __sync_fetch_and_sub(&b->writers, 1))
+        doorbell_ring(&b->bell);
+
+    if (NULL != full)
+        batch_flush(comp, full);
+    if (NULL != flush)
+        batch_flush(comp, flush);
+    if (NULL != ticket)
+        return 0;
+
+    /* whoever takes batch_joining to 0 seals the batch, so it goes out once
+     * the proposals already on their way have joined */
+    waiter w;
+    waiter_init(&w, &comp->wait_cfg, &b->bell, &comp->batch_wait);
+    while (!b->done)
+        waiter_idle(&w);
+    waiter_busy(&w);
+    dare_log_entry_t* entry = b->entry;
+    batch_release(comp, b);
+    if (NULL == entry)
+        return 1;
+    wait_committed(comp, entry);
+    *entry_ptr = entry;
+    return 0;
+}
+
+dare_log_entry_t* leader_handle_submit_req(struct consensus_component_t* comp, size_t data_size, void* data, uint8_t type, view_stamp* clt_id)
+{
+    if (is_batchable(comp, data_size, type)) {
+        dare_log_entry_t *entry = NULL;
+        if (batch_submit(comp, data_size, data, clt_id, NULL, &entry))
+            return NULL;
+        return entry;
+    }
+
 #ifdef MEASURE_LATENCY
-            clock_add(&c_k);
-            clock_display(comp->sys_log_file, &c_k);
+        clock_handler c_k;
+        clock_init(&c_k);
+        clock_add(&c_k);
+#endif
+
+        dare_log_entry_t *entry = NULL;
+        if (leader_propose(comp, data_size, data, type, clt_id, NULL, &entry))
+            goto handle_submit_req_exit;
+
+#ifdef MEASURE_LATENCY
+        clock_add(&c_k);
+#endif
+
+        wait_committed(comp, entry);
+
+#ifdef MEASURE_LATENCY
+        clock_add(&c_k);
+        clock_display(comp->sys_log_file, &c_k);
 #endif
 
-        }else{
-            goto recheck;
-        }
 handle_submit_req_exit:
     return entry;
 }
 
-static void set_affinity(int core_id)
+int leader_submit_req_async(struct consensus_component_t* comp, size_t data_size, void* data, uint8_t type, view_stamp* clt_id, rsm_ticket* ticket)
+{
+    dare_log_entry_t *entry;
+    if (is_batchable(comp, data_size, type))
+        return batch_submit(comp, data_size, data, clt_id, ticket, &entry);
+    return leader_propose(comp, data_size, data, type, clt_id, ticket, &entry);
+}
+
+/* Copies the ack of follower node_id for the P_OUTPUT entry, which carries
+ * its output hash; returns 1 if the follower has not acked that entry (yet). */
+int leader_output_ack(struct consensus_component_t* comp, dare_log_entry_t* entry, uint32_t node_id, accept_ack* ack)
+{
+    dare_log_t* log = COMP_LOG(comp);
+    *ack = log->ctrl_data.ack[node_id].output[entry->msg_vs.req_id % OUTPUT_ACK_RING];
+    return view_stamp_comp(&ack->msg_vs, &entry->msg_vs) != 0;
+}
+
+/* Whether the ticket of a P_OUTPUT entry can go: every follower sent its
+ * output ack, or the ticket waited ack_wait_us since it committed. */
+static int output_acks_in(consensus_component* comp, rsm_ticket* ticket, uint64_t now)
+{
+    dare_log_t* log = COMP_LOG(comp);
+    uint32_t i;
+
+    if (0 == ticket->ack_deadline)
+        ticket->ack_deadline = now + ticket->ack_wait_us * 1000ULL;
+    else if (now >= ticket->ack_deadline)
+        return 1;
+    for (i = 0; i < comp->group_size; i++) {
+        if (i == *comp->node_id)
+            continue;
+        accept_ack* ack = &log->ctrl_data.ack[i].output[ticket->vs.req_id % OUTPUT_ACK_RING];
+        if (view_stamp_comp(&ack->msg_vs, &ticket->vs) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+int consensus_completion_fd(struct consensus_component_t* comp)
+{
+    if (comp->completion_fd < 0)
+        comp->completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return comp->completion_fd;
+}
+
+/* req_id 0 of view 0 is no request, so it cannot clash with a record */
+static db_key_type commit_point_key(consensus_component* comp)
+{
+    view_stamp vs = {.view_id = SHARD_VIEW_BITS(comp->shard), .req_id = 0};
+    return vstol(&vs);
+}
+
+/* Stores the commit point when it moved; it goes out with the records of
+ * the batch, so the flush after them covers it */
+static void store_commit_point(consensus_component* comp)
+{
+    commit_point point = {.committed = *comp->highest_committed_vs};
+    if (view_stamp_comp(&point.committed, &comp->stored_point) == 0)
+        return;
+    db_key_type key = commit_point_key(comp);
+    if (0 == store_record(comp->db_ptr, sizeof(key), &key, sizeof(point), &point))
+        comp->stored_point = point.committed;
+}
+
+/* Makes the log durable up to the byte counter end, as the durability mode
+ * asks. A file-backed log is the store then; async-flush leaves it to the
+ * log sync thread, the other modes to this one. Otherwise the records are in
+ * the db already, and only fsync-per-batch has anything left to do. */
+static void persist_flush(consensus_component* comp, waiter* w, uint64_t end)
+{
+    uint64_t start = now_ns(), syncs = 0;
+    dare_log_t* log = COMP_LOG(comp);
+
+    if (DURABLE_NONE == comp->durability)
+        return;
+    if (SRV_DATA->log_mapped) {
+        if (DURABLE_ASYNC == comp->durability) {
+            while (log->durable < end)
+                waiter_idle(w);
+            waiter_busy(w);
+        } else {
+            if (0 != log_sync(log, end))
+                fprintf(stderr, "Can not write the log back.\n");
+            syncs = 1;
+        }
+    } else if (DURABLE_BATCH == comp->durability) {
+        if (0 != sync_db(comp->db_ptr))
+            fprintf(stderr, "Can not sync the database.\n");
+        syncs = 1;
+    } else {
+        return;
+    }
+    db_stat_add(&comp->persist_stat, syncs, now_ns() - start);
+}
+
+/* Makes the entries durable in req_id order: they go to the db, unless the
+ * log is backed by a file, and every entry ready at once shares one flush
+ * (one per entry with fsync-per-record). The durable point travels to the
+ * leader with the acks. */
+void *handle_persistence(void* arg)
+{
+    consensus_component* comp = arg;
+    persist_slot *slot, *last;
+    req_id_t next;
+    waiter w;
+
+    waiter_init(&w, &comp->wait_cfg, NULL, &comp->persist_wait);
+
+    for (;;)
+    {
+        next = comp->persist_next;
+        slot = &comp->persist_ring[next & (PERSIST_RING_SIZE - 1)];
+        if (slot->req_id != next) {
+            waiter_idle(&w);
+            continue;
+        }
+        waiter_busy(&w);
+
+        do {
+            if (!SRV_DATA->log_mapped) {
+                db_key_type record_no = vstol(&slot->vs);
+                request_record* record_data = (request_record*)((char*)slot->entry + offsetof(dare_log_entry_t, data_size));
+                if (store_record(comp->db_ptr, sizeof(record_no), &record_no, REQ_RECORD_SIZE(record_data) - 1, record_data))
+                    fprintf(stderr, "Can not save record from database.\n");
+            }
+            last = slot;
+            next++;
+            slot = &comp->persist_ring[next & (PERSIST_RING_SIZE - 1)];
+        } while (DURABLE_RECORD != comp->durability && slot->req_id == next);
+
+        store_commit_point(comp);
+        persist_flush(comp, &w, last->end);
+
+        comp->durable_vs = last->vs;
+        comp->durable_pos = last->end;
+        __sync_synchronize();
+        comp->persist_next = next;
+        doorbell_ring(&comp->persist_bell);
+
+        if (comp->commit_durable && comp->cur_view->leader_id == *comp->node_id)
+            commit_advance(comp);
+    }
+    return NULL;
+}
+
+/* Drives the commit sequencer while asynchronous proposals are pending and
+ * hands their tickets back in log order, through the ticket callback, the
+ * completion eventfd, or by setting ticket->done for pollers. A ticket asking
+ * for the output acks is held back until they are in, without holding up the
+ * tickets behind it. */
+void *handle_completion(void* arg)
+{
+    consensus_component* comp = arg;
+    rsm_ticket *ticket, *next, *held = NULL, **held_tail;
+    uint64_t delivered, now;
+    waiter w;
+
+    waiter_init(&w, &comp->wait_cfg, &comp->commit_bell, &comp->completion_wait);
+
+    for (;;)
+    {
+        if (0 == comp->async_pending) {
+            waiter_busy(&w);
+            sem_wait(&comp->async_sem);
+            continue;
+        }
+
+        commit_advance(comp);
+
+        pthread_spin_lock(&comp->commit_lock);
+        ticket = comp->done_head;
+        comp->done_head = comp->done_tail = NULL;
+        pthread_spin_unlock(&comp->commit_lock);
+
+        // the held tickets go first, they committed earlier
+        if (NULL != held) {
+            for (next = held; NULL != next->next; next = next->next);
+            next->next = ticket;
+            ticket = held;
+            held = NULL;
+        }
+        held_tail = &held;
+        now = (NULL != ticket) ? now_ns() : 0;
+
+        for (delivered = 0; NULL != ticket; ticket = next) {
+            next = ticket->next;
+            if (0 != ticket->ack_wait_us && !output_acks_in(comp, ticket, now)) {
+                ticket->next = NULL;
+                *held_tail = ticket;
+                held_tail = &ticket->next;
+                continue;
+            }
+            rsm_done_cb cb = ticket->cb;
+            void* cb_arg = ticket->cb_arg;
+            ticket->done = 1;
+            if (NULL != cb)
+                cb(ticket, cb_arg);
+            delivered++;
+        }
+        if (delivered > 0) {
+            waiter_busy(&w);
+            __sync_fetch_and_sub(&comp->async_pending, delivered);
+            if (comp->completion_fd >= 0)
+                write(comp->completion_fd, &delivered, sizeof(delivered));
+        } else {
+            waiter_idle(&w);
+        }
+    }
+    return NULL;
+}
+
+static void wait_stats_display(consensus_component* comp)
 {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_id, &cpuset);
-    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0)
-        fprintf(stderr, "pthread_setaffinity_np failed\n");
+    char name[64];
+    snprintf(name, sizeof(name), "shard %"PRIu32" accept wait", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->accept_wait);
+    snprintf(name, sizeof(name), "shard %"PRIu32" propose wait", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->propose_wait);
+    if (comp->batch_cfg.on) {
+        snprintf(name, sizeof(name), "shard %"PRIu32" batch wait", comp->shard);
+        wait_stat_display(comp->sys_log_file, name, &comp->batch_wait);
+    }
+    snprintf(name, sizeof(name), "shard %"PRIu32" commit wait", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->commit_wait);
+    snprintf(name, sizeof(name), "shard %"PRIu32" completion wait", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->completion_wait);
+    snprintf(name, sizeof(name), "shard %"PRIu32" persistence wait", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->persist_wait);
+    snprintf(name, sizeof(name), "shard %"PRIu32" persistence ring full", comp->shard);
+    wait_stat_display(comp->sys_log_file, name, &comp->persist_full_wait);
+    snprintf(name, sizeof(name), "shard %"PRIu32" persistence %s", comp->shard, durability_name(comp->durability));
+    db_stat_display(comp->sys_log_file, name, &comp->persist_stat);
+    if (0 == comp->shard && NULL != comp->db_ptr) {
+        // the shards share the db
+        db_stat stat;
+        db_stat_get(comp->db_ptr, &stat);
+        snprintf(name, sizeof(name), "db %s", durability_name(comp->durability));
+        db_stat_display(comp->sys_log_file, name, &stat);
+    }
+    if (0 == comp->shard)
+        check_stat_display(comp->sys_log_file);
+}
+
+/* Nothing to accept this round; also the place where the wait counters get reported. */
+static void accept_idle(consensus_component* comp, waiter* w)
+{
+    waiter_idle(w);
+    if (comp->stat_log && 0 == (++comp->idle_rounds % WAIT_REPORT_ROUNDS) && now_ns() >= comp->next_report) {
+        wait_stats_display(comp);
+        comp->next_report = now_ns() + 1000000000;
+    }
+}
+
+static void publish_read(consensus_component* comp, dare_log_t* log)
+{
+    uint32_t leader = comp->cur_view->leader_id;
+    if (leader >= comp->group_size)
+        return;
+    dare_ib_ep_t *ep = (dare_ib_ep_t*)SRV_DATA->config.servers[leader].ep;
+    if (0 == ep->rc_connected)
+        return;
+
+    uint32_t my_id = *comp->node_id;
+    uint64_t offset = COMP_LOG_OFFSET(comp) + offsetof(dare_log_t, ctrl_data) + offsetof(ctrl_data_t, read) + sizeof(uint64_t) * my_id;
+    comp->published_read = log->read;
+    post_log_write(leader, &log->read, sizeof(uint64_t), offset);
+}
+
+/* The durable point moved since the last ack; send that ack again with it */
+static void publish_durable(consensus_component* comp, dare_log_t* log)
+{
+    uint32_t leader = comp->cur_view->leader_id;
+    if (leader >= comp->group_size || 0 == log->reply.msg_vs.req_id)
+        return;
+    dare_ib_ep_t *ep = (dare_ib_ep_t*)SRV_DATA->config.servers[leader].ep;
+    if (0 == ep->rc_connected)
+        return;
+
+    uint32_t my_id = *comp->node_id;
+    uint64_t offset = COMP_LOG_OFFSET(comp) + offsetof(dare_log_t, ctrl_data) + offsetof(ctrl_data_t, ack) + sizeof(ack_area_t) * my_id;
+    log->reply.durable = comp->acked_durable = comp->durable_vs;
+    post_log_write(leader, &log->reply, ACCEPT_ACK_SIZE, offset + offsetof(ack_area_t, last));
+}
+
+static int entry_is_complete(dare_log_entry_t* entry)
+{
+    if (entry->data_size == 0)
+        return 0;
+    char* dummy = (char*)((char*)entry + log_entry_len(entry) - 1);
+    return (*dummy == DUMMY_END); // atmoic opeartion
+}
+
+/* The entry at the byte counter *pos, skipping (and clearing) wrap markers;
+ * NULL once pos reaches end. */
+static dare_log_entry_t* entry_at(dare_log_t* log, uint64_t* pos, uint64_t end)
+{
+    while (*pos < end) {
+        uint64_t off = *pos % log->len;
+        dare_log_entry_t* entry = (dare_log_entry_t*)(log->entries + off);
+        if (log_fit_entry_header(log, off) && entry->type != WRAP_MARK)
+            return entry;
+        if (log_fit_entry_header(log, off))
+            memset(entry, 0, log_entry_len(entry));
+        *pos += log->len - off;
+    }
+    return NULL;
+}
+
+/* The committed entry index, if it is still in the log */
+static dare_log_entry_t* indexed_entry(consensus_component* comp, dare_log_t* log, db_key_type index)
+{
+    view_stamp vs = ltovs(index);
+    entry_slot* slot = &comp->entry_index[vs.req_id & (ENTRY_INDEX_SIZE - 1)];
+    if (view_stamp_comp(&slot->vs, &vs) != 0 || slot->pos < log->read)
+        return NULL;
+    dare_log_entry_t* entry = (dare_log_entry_t*)(log->entries + slot->pos % log->len);
+    return (view_stamp_comp(&entry->msg_vs, &vs) == 0) ? entry : NULL;
+}
+
+/* Applies the entries up to committed, reading them in place, and takes them
+ * off the log once they are durable too. Only entries gone from the log come
+ * from the db. Clearing the applied entries keeps stale bytes from passing for a complete entry on the
+ * next lap, and only then do they count as read. */
+static void apply_committed(consensus_component* comp, dare_log_t* log, view_stamp* committed)
+{
+    db_key_type index = vstol(comp->highest_committed_vs) + 1;
+    db_key_type end = vstol(committed);
+    dare_log_entry_t* entry;
+
+    for (; index <= end; index++) {
+        entry = indexed_entry(comp, log, index);
+        comp->ucb(index, (NULL != entry) ? (char*)entry + offsetof(dare_log_entry_t, data_size) : NULL, comp->up_para);
+    }
+    *(comp->highest_committed_vs) = *committed;
+
+    uint64_t pos = log->read;
+    while (NULL != (entry = entry_at(log, &pos, log->accepted)) && view_stamp_comp(&entry->msg_vs, committed) <= 0
+            && pos + log_entry_len(entry) <= comp->durable_pos) {
+        pos += log_entry_len(entry);
+        memset(entry, 0, log_entry_len(entry));
+    }
+    log->read = pos;
+}
+
+/* Hands the entries a file-backed log kept from an earlier run to the db,
+ * then starts the shard over; replication begins anew after a restart. */
+static void recover_log(consensus_component* comp, dare_log_t* log)
+{
+    uint64_t pos = (log->read > log->head) ? log->read : log->head;
+    uint64_t end = log->durable;
+    uint32_t records = 0;
+    dare_log_entry_t* entry;
+
+    if (end > log->len && pos < end - log->len)
+        pos = end - log->len;
+    while (NULL != (entry = entry_at(log, &pos, end))) {
+        if (pos + log_entry_len(entry) > end || !entry_is_complete(entry) || entry->version != LOG_ENTRY_VERSION)
+            break;
+        db_key_type record_no = vstol(&entry->msg_vs);
+        request_record* record_data = (request_record*)((char*)entry + offsetof(dare_log_entry_t, data_size));
+        if (0 == store_record(comp->db_ptr, sizeof(record_no), &record_no, REQ_RECORD_SIZE(record_data) - 1, record_data))
+            records++;
+        pos += log_entry_len(entry);
+    }
+    if (records > 0)
+        fprintf(stderr, "CONSENSUS : shard %"PRIu32" recovered %"PRIu32" records from the log file\n", comp->shard, records);
+
+    uintptr_t start = (uintptr_t)log & ~((uintptr_t)PAGE_SIZE - 1);
+    memset(log->entries, 0, log->len);
+    log->head = log->read = log->write = log->accepted = log->durable = 0;
+    log->end = log->tail = log->len;
+    msync((void*)start, (uintptr_t)(log->entries + log->len) - start, MS_SYNC);
+}
+
+/* Picks up where an earlier run of the shard stopped: at the commit point it
+ * stored. Records stored after the point may never have reached a quorum, so
+ * they are dropped; the proposals after the point overwrite them. A follower
+ * whose point is behind the leader's applies the records in between from the
+ * db, once the leader's entries mark them committed. Runs before the shard's
+ * threads start. Like recover_log, this is for restarting the whole group; a
+ * single node does not catch up with its peers. */
+void recover_consensus_comp(consensus_component* comp)
+{
+    db_key_type key = commit_point_key(comp);
+    commit_point* point = NULL;
+    size_t size = 0;
+    uint32_t dropped = 0;
+    uint64_t start = now_ns();
+
+    if (SRV_DATA->log_mapped)
+        recover_log(comp, COMP_LOG(comp));
+
+    if (0 != retrieve_record(comp->db_ptr, sizeof(key), &key, &size, (void**)&point) || NULL == point)
+        return;
+    if (size != sizeof(commit_point)) {
+        free(point);
+        return;
+    }
+
+    view_stamp end = point->committed;
+    for (;;) {
+        view_stamp next = {.view_id = end.view_id, .req_id = end.req_id + 1 + dropped};
+        void* record = NULL;
+        key = vstol(&next);
+        if (0 != retrieve_record(comp->db_ptr, sizeof(key), &key, &size, &record) || NULL == record)
+            break;
+        free(record);
+        dropped++;
+    }
+
+    comp->stored_point = end;
+    *comp->highest_seen_vs = end;
+    *comp->highest_to_commit_vs = end;
+    *comp->highest_committed_vs = end;
+    comp->durable_vs = end;
+    comp->persist_next = end.req_id + 1;
+    comp->persist_resync = 1;
+
+    fprintf(stderr, "CONSENSUS : shard %"PRIu32" resumes after %"PRIu32".%"PRIu32", %"PRIu32" uncommitted records dropped, found in %"PRIu64" us\n",
+        comp->shard, end.view_id & ~SHARD_VIEW_BITS(comp->shard), end.req_id, dropped, (now_ns() - start) / 1000);
+    free(point);
 }
 
 void *handle_accept_req(void* arg)
 {
     consensus_component* comp = arg;
 
-    db_key_type start;
-    db_key_type end;
-    db_key_type index;
-    
     dare_log_entry_t* entry;
+    dare_log_entry_t* last;
+    uint32_t accepted;
+    uint64_t consumed;
+
+    waiter w;
+
+    // RDMA writes cannot ring a doorbell, so a parked follower just sleeps
+    waiter_init(&w, &comp->wait_cfg, NULL, &comp->accept_wait);
 
-    set_affinity(1);
 
     for (;;)
     {
         if (comp->cur_view->leader_id != *comp->node_id)
         {
-            comp->uc(comp->up_para);
-
-            entry = log_get_entry(SRV_DATA->log, &SRV_DATA->log->end);
+            dare_log_t* log = COMP_LOG(comp);
+            if (0 == comp->shard)
+                comp->uc(comp->up_para);
 
-            if (entry->data_size != 0)
+            /* take every complete entry already in the log; they are acked together */
+            last = NULL;
+            consumed = 0;
+            for (accepted = 0; accepted < ACK_GROUP_MAX;)
             {
-                char* dummy = (char*)((char*)entry + log_entry_len(entry) - 1);
-                if (*dummy == DUMMY_END) // atmoic opeartion
-                {
-#ifdef MEASURE_LATENCY
-                    clock_handler c_k;
-                    clock_init(&c_k);
-                    clock_add(&c_k);
-#endif
-                    if(entry->msg_vs.view_id < comp->cur_view->view_id){
-                    // TODO
-                    //goto reloop;
-                    }
-                    // if we this message is not from the current leader
-                    if(entry->msg_vs.view_id == comp->cur_view->view_id && entry->node_id != comp->cur_view->leader_id){
-                    // TODO
-                    //goto reloop;
-                    }
-
-                    // update highest seen request
-                    if(view_stamp_comp(&entry->msg_vs, comp->highest_seen_vs) > 0){
-                        *(comp->highest_seen_vs) = entry->msg_vs;
-                    }
-
-                    db_key_type record_no = vstol(&entry->msg_vs);
-                    // record the data persistently
-                    request_record* record_data = (request_record*)((char*)entry + offsetof(dare_log_entry_t, data_size));
-
-                    store_record(comp->db_ptr, sizeof(record_no), &record_no, REQ_RECORD_SIZE(record_data) - 1, record_data);
+                if (!log_fit_entry_header(log, log->end)) {
+                    consumed += log->len - log->end;
+                    log->end = 0;
+                }
+                entry = (dare_log_entry_t*)(log->entries + log->end);
+                if (!entry_is_complete(entry))
+                    break;
+
+                if (entry->version != LOG_ENTRY_VERSION) {
+                    fprintf(stderr, "CONSENSUS : shard %"PRIu32" got a version %u log entry, expected %u; not accepting any more entries\n",
+                        comp->shard, entry->version, LOG_ENTRY_VERSION);
+                    return NULL;
+                }
+
+                if (entry->type == WRAP_MARK) {
+                    // cleared when the entries before it are applied
+                    consumed += log->len - log->end;
+                    log->end = 0;
+                    continue;
+                }
+
+                if(entry->msg_vs.view_id < comp->cur_view->view_id){
+                // TODO
+                //goto reloop;
+                }
+                // if we this message is not from the current leader
+                if(entry->msg_vs.view_id == comp->cur_view->view_id && entry->node_id != comp->cur_view->leader_id){
+                // TODO
+                //goto reloop;
+                }
+
+                // update highest seen request
+                if(view_stamp_comp(&entry->msg_vs, comp->highest_seen_vs) > 0){
+                    *(comp->highest_seen_vs) = entry->msg_vs;
+                }
+
+                entry_slot* slot = &comp->entry_index[entry->msg_vs.req_id & (ENTRY_INDEX_SIZE - 1)];
+                slot->vs = entry->msg_vs;
+                slot->pos = log->accepted + consumed;
+
+                // record the data persistently, off the accept path
+                persist_enqueue(comp, entry, slot->pos + log_entry_len(entry));
+
+                log->tail = log->end;
+                log->end += log_entry_len(entry);
+                consumed += log_entry_len(entry);
+                accepted++;
+                last = entry;
+
+                // the output hash goes with the ack of this very entry
+                if (entry->type == P_OUTPUT)
+                    break;
+            }
+            log->accepted += consumed;
+            if (NULL == last) {
+                // nothing new; let the leader know everything read so far
+                if (log->read != comp->published_read)
+                    publish_read(comp, log);
+                if (view_stamp_comp(&comp->durable_vs, &comp->acked_durable) != 0)
+                    publish_durable(comp, log);
+                accept_idle(comp, &w);
+                continue;
+            }
+            waiter_busy(&w);
+            entry = last;
 
 #ifdef MEASURE_LATENCY
-                    clock_add(&c_k);
+            clock_handler c_k;
+            clock_init(&c_k);
+            clock_add(&c_k);
 #endif
-                    SRV_DATA->log->tail = SRV_DATA->log->end;
-                    SRV_DATA->log->end += log_entry_len(entry);
-                    uint32_t my_id = *comp->node_id;
-                    uint32_t offset = (uint32_t)(offsetof(dare_log_t, entries) + SRV_DATA->log->tail + ACCEPT_ACK_SIZE * my_id);
-
-                    accept_ack* reply = (accept_ack*)((char*)entry + ACCEPT_ACK_SIZE * my_id);
-                    reply->node_id = my_id;
-                    reply->msg_vs.view_id = entry->msg_vs.view_id;
-                    reply->msg_vs.req_id = entry->msg_vs.req_id;
-                    
-                    if (entry->type == P_OUTPUT)
-                    {
-                        // up = get_mapping_fd() is defined in ev_mgr.c
-                        int fd = comp->ug(entry->clt_id, comp->up_para);
-                        // consider entry->data as a pointer.
-                        uint64_t hash = get_output_hash(fd, *(long*)entry->data);
-                        reply->hash = hash;    
-                    }
-
-                    rem_mem_t rm;
-                    dare_ib_ep_t *ep = (dare_ib_ep_t*)SRV_DATA->config.servers[entry->node_id].ep;
-                    memset(&rm, 0, sizeof(rem_mem_t));
-                    uint32_t *send_count_ptr = &(ep->rc_ep.rc_qp.send_count);
-                    int send_flags, poll_completion = 0;
-
-                    if((*send_count_ptr & S_DEPTH_) == 0)
-                        send_flags = IBV_SEND_SIGNALED;
-                    else
-                        send_flags = 0;
-
-                    if ((*send_count_ptr & S_DEPTH_) == S_DEPTH_)
-                        poll_completion = 1;
-
-                    (*send_count_ptr)++;
-
-                    rm.raddr = ep->rc_ep.rmt_mr.raddr + offset;
-                    rm.rkey = ep->rc_ep.rmt_mr.rkey;
-
-                    post_send(entry->node_id, reply, ACCEPT_ACK_SIZE, IBDEV->lcl_mr, IBV_WR_RDMA_WRITE, &rm, send_flags, poll_completion);
-
-                    if(view_stamp_comp(&entry->req_canbe_exed, comp->highest_committed_vs) > 0)
-                    {
-                        start = vstol(comp->highest_committed_vs)+1;
-                        end = vstol(&entry->req_canbe_exed);
-                        for(index = start; index <= end; index++)
-                        {
-                            comp->ucb(index,comp->up_para);
-                        }
-                        *(comp->highest_committed_vs) = entry->req_canbe_exed;
-                    }
+            /* one cumulative ack, for the last entry of the group */
+            uint32_t my_id = *comp->node_id;
+            uint64_t offset = COMP_LOG_OFFSET(comp) + offsetof(dare_log_t, ctrl_data) + offsetof(ctrl_data_t, ack) + sizeof(ack_area_t) * my_id;
+
+            accept_ack* reply = &log->reply;
+            reply->hash = 0;
+            reply->has_hash = 0;
+            reply->node_id = my_id;
+            reply->msg_vs.view_id = entry->msg_vs.view_id;
+            reply->msg_vs.req_id = entry->msg_vs.req_id;
+            reply->durable = comp->acked_durable = comp->durable_vs;
+            
+            if (entry->type == P_OUTPUT)
+            {
+                // up = get_mapping_fd() is defined in ev_mgr.c
+                int fd = comp->ug(entry->clt_id, comp->up_para);
+                // consider entry->data as a pointer.
+                reply->has_hash = (0 == get_output_hash(fd, *(long*)entry->data, &reply->hash));
+                // the same QP delivers it before the ack that lets the output commit
+                post_log_write(entry->node_id, reply, ACCEPT_ACK_SIZE, offset + offsetof(ack_area_t, output)
+                    + ACCEPT_ACK_SIZE * (entry->msg_vs.req_id % OUTPUT_ACK_RING));
+            }
+
+            post_log_write(entry->node_id, reply, ACCEPT_ACK_SIZE, offset + offsetof(ack_area_t, last));
+
+            if(view_stamp_comp(&entry->req_canbe_exed, comp->highest_committed_vs) > 0)
+                apply_committed(comp, log, &entry->req_canbe_exed);
+
+            if (log->read - comp->published_read >= (log->len >> READ_PUBLISH_SHIFT))
+                publish_read(comp, log);
 #ifdef MEASURE_LATENCY
-                    clock_add(&c_k);
-                    clock_display(comp->sys_log_file, &c_k);
+            clock_add(&c_k);
+            clock_display(comp->sys_log_file, &c_k);
 #endif
-                }   
-            }
+        } else {
+            accept_idle(comp, &w);
         }
     }
 };
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <db.h>
+#include "../include/db/db-engine.h"
+#include "../include/util/debug.h"
+
+const char* db_dir="./.db";
+u_int32_t pagesize = 32 * 1024;
+u_int cachesize = 32 * 1024 * 1024;
+// how often async-flush writes a BerkeleyDB back (microseconds)
+uint32_t db_flush_us = 1000;
+//#define ENV
+
+typedef struct bdb_t{
+    DB* b_db;
+    durability mode;
+    db_stat stat;
+    pthread_t flusher;
+    volatile int stop;
+}bdb;
+
+void mk_path(char* dest,const char* prefix,const char* db_name){
+    memcpy(dest,prefix,strlen(prefix));
+    dest[strlen(prefix)] = '/';
+    memcpy(dest+strlen(prefix)+1,db_name,strlen(db_name));
+    dest[strlen(prefix)+strlen(db_name)+1] = '\0';
+    return;
+}
+
+static int bdb_sync(void* handle){
+    bdb* b = (bdb*)handle;
+    uint64_t start = db_now_ns();
+    int ret = b->b_db->sync(b->b_db, 0);
+    if(ret != 0){
+        err_log("DB : %s.\n", db_strerror(ret));
+    }
+    db_stat_add(&b->stat, 1, db_now_ns() - start);
+    return ret;
+}
+
+static void* bdb_flusher(void* arg){
+    bdb* b = (bdb*)arg;
+    struct timespec interval;
+    interval.tv_sec = db_flush_us / 1000000;
+    interval.tv_nsec = (db_flush_us % 1000000) * 1000;
+
+    while(!b->stop){
+        nanosleep(&interval, NULL);
+        bdb_sync(b);
+    }
+    return NULL;
+}
+
+static void* bdb_open(const char* db_name, uint32_t flag, durability mode){
+    bdb* b = NULL;
+    DB* b_db;
+    int ret;
+    char* full_path = NULL;
+#ifdef ENV
+    DB_ENV* dbenv;
+    if((ret = mkdir(db_dir,S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) != 0){
+        if(errno!=EEXIST){
+            err_log("DB : Dir Creation Failed\n");
+            goto db_init_return;
+        }
+    }
+    full_path = (char*)malloc(strlen(db_dir) + strlen(db_name) + 2);
+    mk_path(full_path, db_dir, db_name);
+    if ((ret = db_env_create(&dbenv, 0)) != 0) {
+        dbenv->err(dbenv, ret, "Environment Created: %s", db_dir);
+        goto db_init_return;
+    }
+    if ((ret = dbenv->open(dbenv, db_dir, DB_CREATE|DB_INIT_CDB|DB_INIT_MPOOL|DB_THREAD, 0)) != 0) {
+        //dbenv->err(dbenv, ret, "Environment Open: %s", db_dir);
+        goto db_init_return;
+    }
+    /* Initialize the DB handle */
+    if((ret = db_create(&b_db,dbenv,flag)) != 0){
+        err_log("DB : %s.\n", db_strerror(ret));
+        goto db_init_return;
+    }
+#else
+    /* Initialize the DB handle */
+    if((ret = db_create(&b_db,NULL,flag)) != 0){
+        err_log("DB : %s.\n", db_strerror(ret));
+        goto db_init_return;
+    }
+    if((ret = b_db->set_pagesize(b_db, pagesize)) != 0){
+        err_log("DB : %s.\n", db_strerror(ret));
+        goto db_init_return;
+    }
+    if((ret = b_db->set_cachesize(b_db, 0, cachesize, 1)) != 0){
+        err_log("DB : %s.\n", db_strerror(ret));
+        goto db_init_return;
+    }
+#endif
+    if((ret = b_db->open(b_db, NULL, db_name, NULL, DB_BTREE, DB_THREAD|DB_CREATE, 0)) != 0){ // db_name is the on-disk file that holds the database
+        //b_db->err(b_db,ret,"%s","test.db");
+        goto db_init_return;
+    }
+    b = (bdb*)malloc(sizeof(bdb));
+    memset(b, 0, sizeof(bdb));
+    b->b_db = b_db;
+    b->mode = mode;
+    if(DURABLE_ASYNC == mode && pthread_create(&b->flusher, NULL, bdb_flusher, b) != 0){
+        err_log("DB : Cannot Start The Flusher.\n");
+    }
+
+db_init_return:
+    if(full_path != NULL){
+        free(full_path);
+    }
+    return b;
+}
+
+static void bdb_close(void* handle, uint32_t flag){
+    bdb* b = (bdb*)handle;
+    if(b->flusher){
+        b->stop = 1;
+        pthread_join(b->flusher, NULL);
+    }
+    b->b_db->close(b->b_db, flag);
+    free(b);
+}
+
+static int bdb_put(void* handle, size_t key_size, void* key_data, size_t data_size, void* data){
+    bdb* b = (bdb*)handle;
+    DB* b_db = b->b_db;
+    DBT key,db_data;
+    int ret;
+    memset(&key, 0, sizeof(key));
+    memset(&db_data, 0, sizeof(db_data));
+    key.data = key_data;
+    key.size = key_size;
+    db_data.data = data;
+    db_data.size = data_size;
+    if ((ret = b_db->put(b_db,NULL,&key,&db_data,DB_AUTO_COMMIT)) == 0){
+        if(DURABLE_RECORD == b->mode){
+            ret = bdb_sync(b);
+        }
+    }
+    else{
+        err_log("DB : %s.\n", db_strerror(ret));
+    }
+    return ret;
+}
+
+static int bdb_get(void* handle, size_t key_size, void* key_data, size_t* data_size, void** data){
+    bdb* b = (bdb*)handle;
+    DB* b_db = b->b_db;
+    DBT key, db_data;
+    int ret;
+    memset(&key, 0, sizeof(key));
+    memset(&db_data, 0, sizeof(db_data));
+    key.data = key_data;
+    key.size = key_size;
+    db_data.flags = DB_DBT_MALLOC;
+    if((ret = b_db->get(b_db, NULL, &key, &db_data, 0)) != 0){
+        if(ret != DB_NOTFOUND){
+            err_log("DB : %s.\n", db_strerror(ret));
+        }
+        return ret;
+    }
+    if(!db_data.size){
+        return ret;
+    }
+    *data = db_data.data;
+    *data_size = db_data.size;
+    return ret;
+}
+
+static void bdb_stat(void* handle, db_stat* stat){
+    *stat = ((bdb*)handle)->stat;
+}
+
+const db_engine bdb_engine = {
+    .name = "bdb",
+    .prefix = NULL,
+    .open = bdb_open,
+    .close = bdb_close,
+    .put = bdb_put,
+    .get = bdb_get,
+    .sync = bdb_sync,
+    .stat = bdb_stat,
+};
@@ -1,95 +1,96 @@
 #include <stdlib.h>
 #include <sys/time.h>
-#include <sys/stat.h>
 #include <string.h>
-#include <errno.h>
-#include <db.h>
-#include "../include/db/db-interface.h"
+#include <time.h>
+#include <inttypes.h>
+#include "../include/db/db-engine.h"
 #include "../include/util/debug.h"
 
-const char* db_dir="./.db";
-u_int32_t pagesize = 32 * 1024;
-u_int cachesize = 32 * 1024 * 1024;
-//#define ENV
+// the first engine whose prefix starts the db_name opens it; BerkeleyDB takes the rest
+static const db_engine* engines[] = {&wal_engine, &mem_engine, &bdb_engine};
 
 struct db_t{
-    DB* bdb_ptr;
+    const db_engine* engine;
+    void* handle;
+    durability mode;
 };
 
-void mk_path(char* dest,const char* prefix,const char* db_name){
-    memcpy(dest,prefix,strlen(prefix));
-    dest[strlen(prefix)] = '/';
-    memcpy(dest+strlen(prefix)+1,db_name,strlen(db_name));
-    dest[strlen(prefix)+strlen(db_name)+1] = '\0';
-    return;
+static const char* durability_names[] = {"none", "async-flush", "fsync-per-batch", "fsync-per-record"};
+
+int durability_parse(const char* name, durability* mode){
+    int i;
+    for(i = 0; i < (int)(sizeof(durability_names)/sizeof(durability_names[0])); i++){
+        if(0 == strcmp(name, durability_names[i])){
+            *mode = (durability)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* durability_name(durability mode){
+    return durability_names[mode];
+}
+
+uint64_t db_now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-db* initialize_db(const char* db_name, uint32_t flag){
+void db_stat_add(db_stat* stat, uint64_t syncs, uint64_t ns){
+    __sync_fetch_and_add(&stat->syncs, syncs);
+    __sync_fetch_and_add(&stat->flushes, 1);
+    __sync_fetch_and_add(&stat->flush_ns, ns);
+    if(ns > stat->max_flush_ns){
+        stat->max_flush_ns = ns;
+    }
+}
+
+void db_stat_display(FILE* output, const char* name, db_stat* stat){
+    safe_rec_log(output, "%s: %"PRIu64" syncs in %"PRIu64" flushes, flush mean %"PRIu64" ns, max %"PRIu64" ns\n",
+        name, stat->syncs, stat->flushes, stat->flushes ? stat->flush_ns / stat->flushes : 0, stat->max_flush_ns);
+}
+
+db* initialize_db(const char* db_name, uint32_t flag, durability mode){
     db* db_ptr = NULL;
-    DB* b_db;
-    int ret;
-    char* full_path = NULL;
-#ifdef ENV
-    DB_ENV* dbenv;
-    if((ret = mkdir(db_dir,S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) != 0){
-        if(errno!=EEXIST){
-            err_log("DB : Dir Creation Failed\n");
-            goto db_init_return;
+    const db_engine* engine = NULL;
+    const char* name = db_name;
+    void* handle;
+    uint32_t i;
+
+    for(i = 0; i < sizeof(engines)/sizeof(engines[0]); i++){
+        if(NULL == engines[i]->prefix){
+            engine = engines[i];
+            break;
+        }
+        if(0 == strncmp(db_name, engines[i]->prefix, strlen(engines[i]->prefix))){
+            engine = engines[i];
+            name = db_name + strlen(engines[i]->prefix);
+            break;
         }
     }
-    full_path = (char*)malloc(strlen(db_dir) + strlen(db_name) + 2);
-    mk_path(full_path, db_dir, db_name);
-    if ((ret = db_env_create(&dbenv, 0)) != 0) {
-        dbenv->err(dbenv, ret, "Environment Created: %s", db_dir);
+    if(NULL == (handle = engine->open(name, flag, mode))){
+        err_log("DB : The %s Engine Cannot Open %s.\n", engine->name, name);
         goto db_init_return;
     }
-    if ((ret = dbenv->open(dbenv, db_dir, DB_CREATE|DB_INIT_CDB|DB_INIT_MPOOL|DB_THREAD, 0)) != 0) {
-        //dbenv->err(dbenv, ret, "Environment Open: %s", db_dir);
+    db_ptr = (db*)(malloc(sizeof(db)));
+    if(NULL == db_ptr){
+        err_log("DB : Cannot Allocate The Handle Of %s.\n", name);
+        engine->close(handle, mode);
         goto db_init_return;
     }
-    /* Initialize the DB handle */
-    if((ret = db_create(&b_db,dbenv,flag)) != 0){
-        err_log("DB : %s.\n", db_strerror(ret));
-        goto db_init_return;                                                                                                                                                   
-    }                                                                                                                                                                          
-#else                                                                                                                                                                          
-    /* Initialize the DB handle */                                                                                                                                             
-    if((ret = db_create(&b_db,NULL,flag)) != 0){                                                                                                                               
-        err_log("DB : %s.\n", db_strerror(ret));                                                                                                                               
-        goto db_init_return;                                                                                                                                                   
-    }                                                                                                                                                                          
-    if((ret = b_db->set_pagesize(b_db, pagesize)) != 0){                                                                                                                       
-        err_log("DB : %s.\n", db_strerror(ret));                                                                                                                               
-        goto db_init_return;                                                                                                                                                   
-    }
-    if((ret = b_db->set_cachesize(b_db, 0, cachesize, 1)) != 0){                                                                                                                       
-        err_log("DB : %s.\n", db_strerror(ret));                                                                                                                               
-        goto db_init_return;                                                                                                                                                   
-    }    
-#endif                                                                                                                                                                         
-    if((ret = b_db->open(b_db, NULL, db_name, NULL, DB_BTREE, DB_THREAD|DB_CREATE, 0)) != 0){ // db_name is the on-disk file that holds the database                            
-        //b_db->err(b_db,ret,"%s","test.db");                                                                                                                                  
-        goto db_init_return;                                                                                                                                                   
-    }                                                                                                                                                                          
-    db_ptr = (db*)(malloc(sizeof(db)));                                                                                                                                        
-    db_ptr->bdb_ptr = b_db;                                                                                                                                                    
-                                                                                                                                                                               
-db_init_return:                                                                                                                                                                
-    if(full_path != NULL){                                                                                                                                                     
-        free(full_path);                                                                                                                                                       
-    }                                                                                                                                                                          
-    if(db_ptr != NULL){                                                                                                                                                        
-        ;                                                                                                                                                                      
-    }                                                                                                                                                                          
-    return db_ptr;                                                                                                                                                             
+    db_ptr->engine = engine;
+    db_ptr->handle = handle;
+    db_ptr->mode = mode;
+
+db_init_return:
+    return db_ptr;
 }
 
 void close_db(db* db_p,uint32_t mode){
     if(db_p!=NULL){
-        if(db_p->bdb_ptr!=NULL){
-            db_p->bdb_ptr->close(db_p->bdb_ptr,mode);
-            db_p->bdb_ptr=NULL;
-        }
+        db_p->engine->close(db_p->handle,mode);
         free(db_p);
         db_p = NULL;
     }
@@ -97,59 +98,36 @@ void close_db(db* db_p,uint32_t mode){
 }
 
 int retrieve_record(db* db_p, size_t key_size, void* key_data, size_t* data_size, void** data){
-    int ret = 1;
-    if(NULL == db_p || NULL == db_p->bdb_ptr){
-        if(db_p == NULL){
-          err_log("DB retrieve_record : db_p is null.\n");
-        } else{
-          err_log("DB retrieve_record : db_p->bdb_ptr is null.\n");
-        }
-        goto db_retrieve_return;
-    }
-    DB* b_db = db_p->bdb_ptr;
-    DBT key, db_data;
-    memset(&key, 0, sizeof(key));
-    memset(&db_data, 0, sizeof(db_data));
-    key.data = key_data;
-    key.size = key_size;
-    db_data.flags = DB_DBT_MALLOC;
-    if((ret = b_db->get(b_db, NULL, &key, &db_data, 0)) == 0){
-    }else{
-        err_log("DB : %s.\n", db_strerror(ret));
-        goto db_retrieve_return;
+    if(NULL == db_p){
+        err_log("DB retrieve_record : db_p is null.\n");
+        return 1;
     }
-    if(!db_data.size){
-        goto db_retrieve_return;
-    }
-    *data = db_data.data;
-    *data_size = db_data.size;
-db_retrieve_return:
-    return ret;
+    return db_p->engine->get(db_p->handle, key_size, key_data, data_size, data);
 }
 
 int store_record(db* db_p, size_t key_size, void* key_data, size_t data_size, void* data){
-    int ret = 1;
-    if((NULL == db_p)||(NULL == db_p->bdb_ptr)){
-        if(db_p == NULL){
-          err_log("DB store_record : db_p is null.\n");
-        } else{
-          err_log("DB store_recor : db_p->bdb_ptr is null.\n");
-        }
-        goto db_store_return;
+    if(NULL == db_p){
+        err_log("DB store_record : db_p is null.\n");
+        return 1;
     }
-    DB* b_db = db_p->bdb_ptr;
-    DBT key,db_data;
-    memset(&key, 0, sizeof(key));
-    memset(&db_data, 0, sizeof(db_data));
-    key.data = key_data;
-    key.size = key_size;
-    db_data.data = data;
-    db_data.size = data_size;
-    if ((ret = b_db->put(b_db,NULL,&key,&db_data,DB_AUTO_COMMIT)) == 0){
-    }
-    else{
-        err_log("DB : %s.\n", db_strerror(ret));
+    return db_p->engine->put(db_p->handle, key_size, key_data, data_size, data);
+}
+
+int sync_db(db* db_p){
+    if(NULL == db_p || DURABLE_BATCH != db_p->mode){
+        return 0;
     }
-db_store_return:
-    return ret;
+    return db_p->engine->sync(db_p->handle);
+}
+
+durability db_durability(db* db_p){
+    return (NULL == db_p) ? DURABLE_NONE : db_p->mode;
+}
+
+void db_stat_get(db* db_p, db_stat* stat){
+    db_p->engine->stat(db_p->handle, stat);
+}
+
+const char* db_engine_name(db* db_p){
+    return db_p->engine->name;
 }
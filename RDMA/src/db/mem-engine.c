@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <sys/time.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/db/db-engine.h"
+#include "../include/ev_mgr/uthash.h"
+#include "../include/util/debug.h"
+
+/* Records in a hash table in memory; nothing survives the process, so the
+ * durability mode does not apply. For tests, benchmarks and replicas that
+ * recover from their peers. */
+
+typedef struct mem_record_t{
+    UT_hash_handle hh;
+    size_t data_size;
+    void* data;
+    size_t key_size;
+    char key[0];
+}mem_record;
+
+typedef struct mem_db_t{
+    mem_record* records;
+    pthread_rwlock_t lock;
+    db_stat stat;
+}mem_db;
+
+static void* mem_open(const char* name, uint32_t flag, durability mode){
+    mem_db* m = (mem_db*)malloc(sizeof(mem_db));
+    if(NULL == m){
+        return NULL;
+    }
+    memset(m, 0, sizeof(mem_db));
+    pthread_rwlock_init(&m->lock, NULL);
+    return m;
+}
+
+static void mem_close(void* handle, uint32_t flag){
+    mem_db* m = (mem_db*)handle;
+    mem_record *rec, *tmp;
+    HASH_ITER(hh, m->records, rec, tmp){
+        HASH_DEL(m->records, rec);
+        free(rec->data);
+        free(rec);
+    }
+    pthread_rwlock_destroy(&m->lock);
+    free(m);
+}
+
+static int mem_put(void* handle, size_t key_size, void* key, size_t data_size, void* data){
+    mem_db* m = (mem_db*)handle;
+    mem_record* rec = NULL;
+    void* copy = malloc(data_size);
+    if(NULL == copy){
+        err_log("DB : Cannot Malloc Memory For A Record.\n");
+        return 1;
+    }
+    memcpy(copy, data, data_size);
+
+    pthread_rwlock_wrlock(&m->lock);
+    HASH_FIND(hh, m->records, key, key_size, rec);
+    if(NULL == rec){
+        rec = (mem_record*)malloc(sizeof(mem_record) + key_size);
+        rec->key_size = key_size;
+        memcpy(rec->key, key, key_size);
+        HASH_ADD(hh, m->records, key[0], key_size, rec);
+    }else{
+        free(rec->data);
+    }
+    rec->data = copy;
+    rec->data_size = data_size;
+    pthread_rwlock_unlock(&m->lock);
+    return 0;
+}
+
+static int mem_get(void* handle, size_t key_size, void* key, size_t* data_size, void** data){
+    mem_db* m = (mem_db*)handle;
+    mem_record* rec = NULL;
+    int ret = 1;
+
+    pthread_rwlock_rdlock(&m->lock);
+    HASH_FIND(hh, m->records, key, key_size, rec);
+    if(NULL != rec){
+        *data = malloc(rec->data_size);
+        memcpy(*data, rec->data, rec->data_size);
+        *data_size = rec->data_size;
+        ret = 0;
+    }
+    pthread_rwlock_unlock(&m->lock);
+    return ret;
+}
+
+static int mem_sync(void* handle){
+    return 0;
+}
+
+static void mem_stat(void* handle, db_stat* stat){
+    *stat = ((mem_db*)handle)->stat;
+}
+
+const db_engine mem_engine = {
+    .name = "mem",
+    .prefix = "mem:",
+    .open = mem_open,
+    .close = mem_close,
+    .put = mem_put,
+    .get = mem_get,
+    .sync = mem_sync,
+    .stat = mem_stat,
+};
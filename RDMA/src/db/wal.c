@@ -0,0 +1,630 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "../include/db/wal.h"
+#include "../include/db/db-engine.h"
+#include "../include/util/debug.h"
+
+uint64_t wal_segment_size = 64 * 1024 * 1024;
+uint64_t wal_buffer_size = 4 * 1024 * 1024;
+uint32_t wal_flush_us = 1000;
+uint32_t wal_scan_threads = 4;
+
+#define WAL_ALIGN(n) (((n) + 7) & ~((uint64_t)7))
+#define WAL_LOC(seg, offset) ((((uint64_t)(seg) << 32) | (offset)) + 1)
+
+typedef struct wal_record_t{
+    uint64_t key;
+    uint32_t size;  // bytes of data
+    uint32_t sum;   // of key, size and data; unwritten or torn records fail it
+    char data[0];
+}wal_record;
+
+/* records appended since the last flush; they go to seg at offset */
+typedef struct wal_buffer_t{
+    char* data;
+    uint64_t len;
+    uint64_t cap;
+    uint32_t seg;
+    uint64_t offset;
+}wal_buffer;
+
+/* where the records of one view are, indexed by req_id */
+typedef struct wal_view_t{
+    uint32_t view_id;
+    uint64_t* loc;  // WAL_LOC() of the record, 0 if there is none
+    uint64_t len;   // up to 2^32, one slot per req_id
+}wal_view;
+
+struct wal_t{
+    char* dir;
+
+    pthread_mutex_t lock;       // appends, buffers, segments and the index
+    pthread_mutex_t flush_lock; // one flush at a time
+    wal_buffer buf[2];
+    int active;
+
+    int* fds;       // every segment; records are appended to the last one
+    uint32_t segs;
+    uint64_t end;   // offset after the last record of the last segment
+
+    wal_view* views;
+    uint32_t view_count;
+
+    durability mode;
+    db_stat stat;
+
+    pthread_t flusher;
+    volatile int stop;
+};
+
+static uint32_t wal_sum(uint64_t key, uint32_t size, const void* data)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    uint32_t h = 2166136261u;
+    uint32_t i;
+    for (i = 0; i < sizeof(key); i++)
+        h = (h ^ (unsigned char)(key >> (i * 8))) * 16777619u;
+    for (i = 0; i < sizeof(size); i++)
+        h = (h ^ (unsigned char)(size >> (i * 8))) * 16777619u;
+    for (i = 0; i < size; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static uint64_t* wal_index_slot(wal* w, uint64_t key, int create)
+{
+    uint32_t view_id = (uint32_t)(key >> 32);
+    uint32_t req_id = (uint32_t)key;
+    wal_view* v = NULL;
+    uint32_t i;
+
+    for (i = 0; i < w->view_count; i++) {
+        if (w->views[i].view_id == view_id) {
+            v = &w->views[i];
+            break;
+        }
+    }
+    if (NULL == v) {
+        if (!create)
+            return NULL;
+        wal_view* views = (wal_view*)realloc(w->views, sizeof(wal_view) * (w->view_count + 1));
+        if (NULL == views)
+            return NULL;
+        w->views = views;
+        v = &w->views[w->view_count++];
+        memset(v, 0, sizeof(wal_view));
+        v->view_id = view_id;
+    }
+    if (req_id >= v->len) {
+        if (!create)
+            return NULL;
+        // grown in 64 bits, as doubling past req_id 2^31 would wrap a uint32_t to 0
+        uint64_t len = (v->len == 0) ? 4096 : v->len;
+        while (len <= req_id)
+            len *= 2;
+        uint64_t* loc = (uint64_t*)realloc(v->loc, sizeof(uint64_t) * len);
+        if (NULL == loc) {
+            err_log("WAL : Cannot Grow The Index Of View %"PRIu32" To %"PRIu64" Records.\n", view_id, len);
+            return NULL;
+        }
+        v->loc = loc;
+        memset(v->loc + v->len, 0, sizeof(uint64_t) * (len - v->len));
+        v->len = len;
+    }
+    return &v->loc[req_id];
+}
+
+static int wal_segment_open(wal* w, uint32_t seg, int create)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%08"PRIu32".wal", w->dir, seg);
+    int fd = open(path, O_RDWR | (create ? O_CREAT : 0), S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        err_log("WAL : Cannot Open Segment %s: %s.\n", path, strerror(errno));
+        return -1;
+    }
+    if (create) {
+        // allocate the blocks up front, so appends do not grow the file
+        int ret = posix_fallocate(fd, 0, wal_segment_size);
+        if (ret != 0) {
+            err_log("WAL : Cannot Preallocate Segment %s: %s.\n", path, strerror(ret));
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static int wal_segment_add(wal* w)
+{
+    int fd = wal_segment_open(w, w->segs, 1);
+    if (fd < 0)
+        return 1;
+    int* fds = (int*)realloc(w->fds, sizeof(int) * (w->segs + 1));
+    if (NULL == fds) {
+        err_log("WAL : Cannot Grow The Segment Table To %"PRIu32" Segments.\n", w->segs + 1);
+        close(fd);
+        return 1;
+    }
+    w->fds = fds;
+    w->fds[w->segs++] = fd;
+    w->end = 0;
+    return 0;
+}
+
+/* what a reader found in one segment: its records, in order, up to the
+ * first one that was never (completely) written, and the offset after it */
+typedef struct wal_scan_t{
+    int fd;
+    uint32_t seg;
+    uint64_t* keys;
+    uint64_t* locs;
+    uint32_t count;
+    uint32_t cap;
+    uint64_t end;
+    int failed;                 // ran out of memory, the findings are incomplete
+}wal_scan;
+
+typedef struct wal_scan_job_t{
+    wal_scan* scans;
+    uint32_t segs;
+    volatile uint32_t next;     // next segment to take
+}wal_scan_job;
+
+/* Reads a segment front to back in wal_buffer_size pieces */
+static void wal_segment_scan(wal_scan* s)
+{
+    uint64_t cap = wal_buffer_size, base = 0, len = 0, offset = 0;
+    char* buf = (char*)malloc(cap);
+
+    if (NULL == buf) {
+        s->failed = 1;
+        return;
+    }
+    while (offset + sizeof(wal_record) <= wal_segment_size) {
+        wal_record* rec = (wal_record*)(buf + (offset - base));
+        int whole = offset + sizeof(wal_record) <= base + len;
+        if (!whole || offset + sizeof(wal_record) + rec->size > base + len) {
+            // read on from this record, all of it if it is larger than the buffer
+            uint64_t want = cap;
+            if (whole && sizeof(wal_record) + rec->size > want)
+                want = sizeof(wal_record) + rec->size;
+            if (want > wal_segment_size - offset)
+                want = wal_segment_size - offset;
+            if (base == offset && want <= len)
+                break;
+            if (want > cap) {
+                char* grown = (char*)realloc(buf, want);
+                if (NULL == grown) {
+                    s->failed = 1;
+                    break;
+                }
+                buf = grown;
+                cap = want;
+            }
+            ssize_t n = pread(s->fd, buf, want, offset);
+            if (n < (ssize_t)sizeof(wal_record))
+                break;
+            base = offset;
+            len = n;
+            continue;
+        }
+        if (wal_sum(rec->key, rec->size, rec->data) != rec->sum)
+            break;
+        if (s->count == s->cap) {
+            uint32_t cap = (s->cap == 0) ? 4096 : s->cap * 2;
+            uint64_t* keys = (uint64_t*)realloc(s->keys, sizeof(uint64_t) * cap);
+            if (NULL != keys)
+                s->keys = keys;
+            uint64_t* locs = (NULL == keys) ? NULL : (uint64_t*)realloc(s->locs, sizeof(uint64_t) * cap);
+            if (NULL == locs) {
+                s->failed = 1;
+                break;
+            }
+            s->locs = locs;
+            s->cap = cap;
+        }
+        s->keys[s->count] = rec->key;
+        s->locs[s->count++] = WAL_LOC(s->seg, offset);
+        offset += WAL_ALIGN(sizeof(wal_record) + rec->size);
+    }
+    free(buf);
+    s->end = offset;
+}
+
+static void* wal_scanner(void* arg)
+{
+    wal_scan_job* job = (wal_scan_job*)arg;
+    uint32_t seg;
+    while ((seg = __sync_fetch_and_add(&job->next, 1)) < job->segs)
+        wal_segment_scan(&job->scans[seg]);
+    return NULL;
+}
+
+/* Indexes the segments of an earlier run. Up to wal_scan_threads readers
+ * take a segment each; their findings go into the index in segment order,
+ * so a later record of a key wins. */
+static int wal_recover(wal* w)
+{
+    DIR* d = opendir(w->dir);
+    struct dirent* ent;
+    uint32_t seg, segs = 0, i, threads;
+
+    if (NULL == d) {
+        err_log("WAL : Cannot Open %s: %s.\n", w->dir, strerror(errno));
+        return 1;
+    }
+    while (NULL != (ent = readdir(d))) {
+        char tail;
+        if (sscanf(ent->d_name, "%08"SCNu32".wa%c", &seg, &tail) == 2 && tail == 'l' && seg + 1 > segs)
+            segs = seg + 1;
+    }
+    closedir(d);
+    if (0 == segs)
+        return 0;
+
+    for (seg = 0; seg < segs; seg++) {
+        int fd = wal_segment_open(w, seg, 0);
+        if (fd < 0)
+            return 1;
+        int* fds = (int*)realloc(w->fds, sizeof(int) * (w->segs + 1));
+        if (NULL == fds) {
+            err_log("WAL : Cannot Grow The Segment Table To %"PRIu32" Segments.\n", w->segs + 1);
+            close(fd);
+            return 1;
+        }
+        w->fds = fds;
+        w->fds[w->segs++] = fd;
+    }
+
+    wal_scan_job job;
+    job.scans = (wal_scan*)calloc(segs, sizeof(wal_scan));
+    if (NULL == job.scans)
+        return 1;
+    job.segs = segs;
+    job.next = 0;
+    for (seg = 0; seg < segs; seg++) {
+        job.scans[seg].fd = w->fds[seg];
+        job.scans[seg].seg = seg;
+    }
+    threads = (segs < wal_scan_threads) ? segs : wal_scan_threads;
+    pthread_t* readers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    if (NULL == readers)
+        threads = 0;
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&readers[i], NULL, wal_scanner, &job) != 0)
+            break;
+    }
+    // whatever is left, for instance if no reader could start, is read here
+    wal_scanner(&job);
+    while (i > 0)
+        pthread_join(readers[--i], NULL);
+    free(readers);
+
+    int rc = 0;
+    for (seg = 0; seg < segs; seg++) {
+        wal_scan* s = &job.scans[seg];
+        if (s->failed) {
+            err_log("WAL : Cannot Index Segment %"PRIu32", Out Of Memory.\n", seg);
+            rc = 1;
+        }
+        for (i = 0; i < s->count && 0 == rc; i++) {
+            uint64_t* slot = wal_index_slot(w, s->keys[i], 1);
+            if (NULL == slot)
+                rc = 1;
+            else
+                *slot = s->locs[i];
+        }
+        free(s->keys);
+        free(s->locs);
+    }
+    w->end = job.scans[segs - 1].end;
+    free(job.scans);
+    return rc;
+}
+
+static uint64_t wal_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Writes out everything appended so far, with one write and, if sync is
+ * set, one fdatasync */
+static int wal_flush(wal* w, int sync)
+{
+    int ret = 0;
+    pthread_mutex_lock(&w->flush_lock);
+
+    pthread_mutex_lock(&w->lock);
+    wal_buffer* b = &w->buf[w->active];
+    w->active ^= 1;
+    w->buf[w->active].seg = w->segs - 1;
+    w->buf[w->active].offset = w->end;
+    int fd = w->fds[b->seg];
+    pthread_mutex_unlock(&w->lock);
+
+    if (b->len > 0) {
+        uint64_t start = wal_now_ns();
+        if (pwrite(fd, b->data, b->len, b->offset) != (ssize_t)b->len || (sync && fdatasync(fd) != 0)) {
+            err_log("WAL : Flush Failed: %s.\n", strerror(errno));
+            ret = 1;
+        }
+        db_stat_add(&w->stat, sync ? 1 : 0, wal_now_ns() - start);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    b->len = 0;
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_unlock(&w->flush_lock);
+    return ret;
+}
+
+static void* wal_flusher(void* arg)
+{
+    wal* w = (wal*)arg;
+    struct timespec interval;
+    interval.tv_sec = wal_flush_us / 1000000;
+    interval.tv_nsec = (wal_flush_us % 1000000) * 1000;
+
+    while (!w->stop) {
+        nanosleep(&interval, NULL);
+        wal_flush(w, DURABLE_NONE != w->mode);
+    }
+    return NULL;
+}
+
+wal* wal_open(const char* dir, durability mode)
+{
+    wal* w = (wal*)malloc(sizeof(wal));
+    if (NULL == w)
+        return NULL;
+    memset(w, 0, sizeof(wal));
+
+    if (mkdir(dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+        err_log("WAL : Cannot Create %s: %s.\n", dir, strerror(errno));
+        goto wal_open_error;
+    }
+    w->dir = strdup(dir);
+    w->mode = mode;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_mutex_init(&w->flush_lock, NULL);
+
+    if (wal_recover(w))
+        goto wal_open_error;
+    // new records never go into a segment written by an earlier run
+    if (wal_segment_add(w))
+        goto wal_open_error;
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        w->buf[i].cap = wal_buffer_size;
+        w->buf[i].data = (char*)malloc(w->buf[i].cap);
+        if (NULL == w->buf[i].data)
+            goto wal_open_error;
+    }
+    w->buf[w->active].seg = w->segs - 1;
+    w->buf[w->active].offset = w->end;
+
+    // with fsync-per-batch and fsync-per-record the writers flush
+    if (mode <= DURABLE_ASYNC && pthread_create(&w->flusher, NULL, wal_flusher, w) != 0) {
+        err_log("WAL : Cannot Start The Flusher.\n");
+        goto wal_open_error;
+    }
+    return w;
+
+wal_open_error:
+    wal_close(w);
+    return NULL;
+}
+
+void wal_close(wal* w)
+{
+    uint32_t i;
+    if (NULL == w)
+        return;
+    if (w->flusher) {
+        w->stop = 1;
+        pthread_join(w->flusher, NULL);
+    }
+    if (w->buf[0].data && w->buf[1].data) {
+        wal_flush(w, 1);
+        wal_flush(w, 1);
+    }
+    for (i = 0; i < w->segs; i++)
+        close(w->fds[i]);
+    for (i = 0; i < w->view_count; i++)
+        free(w->views[i].loc);
+    free(w->views);
+    free(w->fds);
+    free(w->buf[0].data);
+    free(w->buf[1].data);
+    free(w->dir);
+    free(w);
+}
+
+int wal_append(wal* w, uint64_t key, size_t data_size, void* data)
+{
+    uint64_t need = WAL_ALIGN(sizeof(wal_record) + data_size);
+    if (need > wal_segment_size) {
+        err_log("WAL : A %zu Byte Record Does Not Fit In A Segment.\n", data_size);
+        return 1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        wal_buffer* b = &w->buf[w->active];
+        int roll = (w->end + need > wal_segment_size);
+        if (b->len > 0 && (roll || b->len + need > b->cap)) {
+            // the buffer must go to its segment first
+            pthread_mutex_unlock(&w->lock);
+            wal_flush(w, DURABLE_NONE != w->mode);
+            pthread_mutex_lock(&w->lock);
+            continue;
+        }
+        if (roll) {
+            if (wal_segment_add(w)) {
+                pthread_mutex_unlock(&w->lock);
+                return 1;
+            }
+            b->seg = w->segs - 1;
+            b->offset = w->end;
+        }
+        if (need > b->cap) {
+            char* data = (char*)realloc(b->data, need);
+            if (NULL == data) {
+                pthread_mutex_unlock(&w->lock);
+                return 1;
+            }
+            b->data = data;
+            b->cap = need;
+        }
+        break;
+    }
+
+    // taken before the record goes in, so a record is never left without an index slot
+    uint64_t* slot = wal_index_slot(w, key, 1);
+    if (NULL == slot) {
+        pthread_mutex_unlock(&w->lock);
+        return 1;
+    }
+    wal_buffer* b = &w->buf[w->active];
+    wal_record* rec = (wal_record*)(b->data + b->len);
+    rec->key = key;
+    rec->size = (uint32_t)data_size;
+    memcpy(rec->data, data, data_size);
+    rec->sum = wal_sum(key, rec->size, data);
+    memset(rec->data + data_size, 0, need - sizeof(wal_record) - data_size);
+    b->len += need;
+
+    *slot = WAL_LOC(w->segs - 1, w->end);
+    w->end += need;
+    pthread_mutex_unlock(&w->lock);
+
+    if (DURABLE_RECORD == w->mode)
+        return wal_flush(w, 1);
+    return 0;
+}
+
+int wal_get(wal* w, uint64_t key, size_t* data_size, void** data)
+{
+    pthread_mutex_lock(&w->lock);
+    uint64_t* slot = wal_index_slot(w, key, 0);
+    if (NULL == slot || 0 == *slot) {
+        pthread_mutex_unlock(&w->lock);
+        return 1;
+    }
+    uint32_t seg = (uint32_t)((*slot - 1) >> 32);
+    uint64_t offset = (uint32_t)(*slot - 1);
+    int i;
+
+    // not flushed yet, the record is still in one of the buffers
+    for (i = 0; i < 2; i++) {
+        wal_buffer* b = &w->buf[i];
+        if (b->len > 0 && b->seg == seg && offset >= b->offset && offset < b->offset + b->len) {
+            wal_record* rec = (wal_record*)(b->data + (offset - b->offset));
+            *data = malloc(rec->size);
+            if (NULL == *data) {
+                pthread_mutex_unlock(&w->lock);
+                return 1;
+            }
+            memcpy(*data, rec->data, rec->size);
+            *data_size = rec->size;
+            pthread_mutex_unlock(&w->lock);
+            return 0;
+        }
+    }
+    int fd = w->fds[seg];
+    pthread_mutex_unlock(&w->lock);
+
+    wal_record hdr;
+    if (pread(fd, &hdr, sizeof(hdr), offset) != sizeof(hdr) || hdr.key != key)
+        return 1;
+    *data = malloc(hdr.size);
+    if (NULL == *data)
+        return 1;
+    if (pread(fd, *data, hdr.size, offset + sizeof(hdr)) != hdr.size) {
+        free(*data);
+        *data = NULL;
+        return 1;
+    }
+    *data_size = hdr.size;
+    return 0;
+}
+
+int wal_sync(wal* w)
+{
+    return wal_flush(w, 1);
+}
+
+void wal_stat_get(wal* w, db_stat* stat)
+{
+    *stat = w->stat;
+}
+
+/* the write-ahead log as a storage engine; keys are view stamps */
+static void* wal_engine_open(const char* dir, uint32_t flag, durability mode)
+{
+    return wal_open(dir, mode);
+}
+
+static void wal_engine_close(void* handle, uint32_t flag)
+{
+    wal_close((wal*)handle);
+}
+
+static int wal_engine_put(void* handle, size_t key_size, void* key, size_t data_size, void* data)
+{
+    if (key_size != sizeof(uint64_t)) {
+        err_log("WAL : Only Takes 8 Byte Keys.\n");
+        return 1;
+    }
+    if (wal_append((wal*)handle, *(uint64_t*)key, data_size, data) != 0) {
+        err_log("WAL : Cannot Append A Record.\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int wal_engine_get(void* handle, size_t key_size, void* key, size_t* data_size, void** data)
+{
+    if (key_size != sizeof(uint64_t)) {
+        err_log("WAL : Only Takes 8 Byte Keys.\n");
+        return 1;
+    }
+    return wal_get((wal*)handle, *(uint64_t*)key, data_size, data);
+}
+
+static int wal_engine_sync(void* handle)
+{
+    return wal_sync((wal*)handle);
+}
+
+static void wal_engine_stat(void* handle, db_stat* stat)
+{
+    wal_stat_get((wal*)handle, stat);
+}
+
+const db_engine wal_engine = {
+    .name = "wal",
+    .prefix = "wal:",
+    .open = wal_engine_open,
+    .close = wal_engine_close,
+    .put = wal_engine_put,
+    .get = wal_engine_get,
+    .sync = wal_engine_sync,
+    .stat = wal_engine_stat,
+};
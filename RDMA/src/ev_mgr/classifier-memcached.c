@@ -0,0 +1,95 @@
+#include "../include/ev_mgr/classifier.h"
+
+/* memcached text protocol: a request is a command line ended by "\r\n";
+ * storage commands carry "<bytes>\r\n" of data after it. */
+
+enum mc_state{
+    MC_START = 0,
+    MC_LINE,
+    MC_DATA,
+};
+
+static const char* const mc_reads[] = {
+    "get", "gets",
+    NULL,
+};
+
+static const char* const mc_stores[] = {
+    "set", "add", "replace", "append", "prepend", "cas",
+    NULL,
+};
+
+// called at the end of a command line; 1 if the request is complete
+static int mc_end_line(classify_state* st)
+{
+    char* save = NULL;
+    char* word = strtok_r(st->line, " \r", &save);
+    if (NULL == word) {
+        st->is_read = 0;
+        return 1;
+    }
+    st->is_read = classify_word_is(word, strlen(word), mc_reads);
+    if (!classify_word_is(word, strlen(word), mc_stores))
+        return 1;
+
+    // <command> <key> <flags> <exptime> <bytes> ...
+    int i;
+    for (i = 0; i < 4 && NULL != word; i++)
+        word = strtok_r(NULL, " \r", &save);
+    if (NULL == word || st->args) {
+        // the line did not fit, so the data length is unknown
+        st->lost = 1;
+        return 0;
+    }
+    st->skip = (size_t)strtoul(word, NULL, 10) + 2;
+    st->state = MC_DATA;
+    return 0;
+}
+
+static int mc_scan(classify_state* st, const char* buf, size_t len)
+{
+    size_t i = 0;
+    int aligned = (MC_START == st->state);
+    int all_read = 1, completed = 0;
+
+    while (i < len && !st->lost) {
+        char c = buf[i];
+        switch (st->state) {
+            case MC_START:
+                st->line_len = 0;
+                st->args = 0;   // set when the line overflows the buffer
+                st->state = MC_LINE;
+                continue;
+            case MC_LINE:
+                i++;
+                if ('\n' != c) {
+                    if (!classify_line_add(st, c))
+                        st->args = 1;
+                    break;
+                }
+                st->state = MC_START;
+                if (mc_end_line(st)) {
+                    completed++;
+                    all_read &= st->is_read;
+                }
+                break;
+            case MC_DATA: {
+                size_t step = (st->skip < len - i) ? st->skip : len - i;
+                i += step;
+                st->skip -= step;
+                if (0 == st->skip) {
+                    st->state = MC_START;
+                    completed++;
+                    all_read = 0;
+                }
+                break;
+            }
+        }
+    }
+    return !st->lost && aligned && MC_START == st->state && completed > 0 && all_read;
+}
+
+const classifier memcached_classifier = {
+    .name = "memcached",
+    .scan = mc_scan,
+};
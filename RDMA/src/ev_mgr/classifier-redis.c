@@ -0,0 +1,116 @@
+#include "../include/ev_mgr/classifier.h"
+
+/* Redis RESP: a request is an array of bulk strings, "*N\r\n" followed by N
+ * times "$L\r\n<L bytes>\r\n"; the first bulk string names the command.
+ * Inline commands (a bare line) are always treated as writes. */
+
+enum resp_state{
+    RESP_START = 0,
+    RESP_ARRAY_HDR,
+    RESP_BULK_HDR,
+    RESP_BULK,
+    RESP_INLINE,
+};
+
+static const char* const resp_reads[] = {
+    "GET", "MGET", "EXISTS", "STRLEN", "GETRANGE",
+    "HGET", "HMGET", "HGETALL", "HEXISTS", "HLEN", "HKEYS", "HVALS",
+    "LRANGE", "LLEN", "LINDEX",
+    "SCARD", "SMEMBERS", "SISMEMBER",
+    "ZRANGE", "ZREVRANGE", "ZRANGEBYSCORE", "ZSCORE", "ZCARD", "ZCOUNT", "ZRANK",
+    "TTL", "PTTL", "TYPE", "PING", "ECHO",
+    NULL,
+};
+
+static int resp_scan(classify_state* st, const char* buf, size_t len)
+{
+    size_t i = 0;
+    int aligned = (RESP_START == st->state);
+    int all_read = 1, completed = 0;
+    long n;
+
+    while (i < len && !st->lost) {
+        char c = buf[i];
+        switch (st->state) {
+            case RESP_START:
+                st->line_len = 0;
+                st->state = ('*' == c) ? RESP_ARRAY_HDR : RESP_INLINE;
+                if (RESP_INLINE == st->state)
+                    st->is_read = 0;
+                continue;
+            case RESP_ARRAY_HDR:
+            case RESP_BULK_HDR:
+                i++;
+                if ('\n' != c) {
+                    if (!classify_line_add(st, c))
+                        st->lost = 1;
+                    break;
+                }
+                n = strtol(st->line + 1, NULL, 10);
+                if (RESP_ARRAY_HDR == st->state) {
+                    if (n <= 0) {
+                        // empty array, nothing to run
+                        st->state = RESP_START;
+                        completed++;
+                        all_read = 0;
+                        break;
+                    }
+                    st->args = (int)n;
+                    st->is_read = -1;
+                    st->state = RESP_BULK_HDR;
+                } else {
+                    if ('$' != st->line[0] || n < 0) {
+                        st->lost = 1;
+                        break;
+                    }
+                    st->skip = (size_t)n + 2;
+                    st->state = RESP_BULK;
+                }
+                st->line_len = 0;
+                break;
+            case RESP_BULK:
+                if (-1 == st->is_read) {
+                    // still reading the command name
+                    if (st->skip > 2)
+                        classify_line_add(st, c);
+                    i++;
+                    st->skip--;
+                } else {
+                    size_t step = (st->skip < len - i) ? st->skip : len - i;
+                    i += step;
+                    st->skip -= step;
+                }
+                if (0 != st->skip)
+                    break;
+                if (-1 == st->is_read)
+                    st->is_read = classify_word_is(st->line, st->line_len, resp_reads);
+                st->line_len = 0;
+                if (0 == --st->args) {
+                    st->state = RESP_START;
+                    completed++;
+                    all_read &= st->is_read;
+                } else {
+                    st->state = RESP_BULK_HDR;
+                }
+                break;
+            case RESP_INLINE: {
+                const char* eol = memchr(buf + i, '\n', len - i);
+                if (NULL == eol) {
+                    i = len;
+                    break;
+                }
+                i = eol - buf + 1;
+                st->state = RESP_START;
+                completed++;
+                all_read = 0;
+                break;
+            }
+        }
+    }
+    return !st->lost && aligned && RESP_START == st->state && completed > 0 && all_read;
+}
+
+const classifier redis_classifier = {
+    .name = "redis",
+    .scan = resp_scan,
+};
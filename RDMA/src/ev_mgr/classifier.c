@@ -0,0 +1,37 @@
+#include "../include/ev_mgr/classifier.h"
+
+static const classifier* classifiers[] = {
+    &redis_classifier,
+    &memcached_classifier,
+    NULL,
+};
+
+const classifier* find_classifier(const char* name)
+{
+    int i;
+    for (i = 0; NULL != classifiers[i]; i++) {
+        if (0 == strcmp(classifiers[i]->name, name))
+            return classifiers[i];
+    }
+    return NULL;
+}
+
+// appends to the current line; 0 once it no longer fits
+int classify_line_add(classify_state* st, char c)
+{
+    if (st->line_len >= CLASSIFY_LINE_MAX - 1)
+        return 0;
+    st->line[st->line_len++] = c;
+    st->line[st->line_len] = '\0';
+    return 1;
+}
+
+int classify_word_is(const char* word, size_t len, const char* const* names)
+{
+    int i;
+    for (i = 0; NULL != names[i]; i++) {
+        if (strlen(names[i]) == len && 0 == strncasecmp(word, names[i], len))
+            return 1;
+    }
+    return 0;
+}
@@ -65,35 +65,91 @@ int mgr_on_process_init(event_manager* ev_mgr)
     *ck_thread = check_point_thread;
     listAddNodeTail(ev_mgr->excluded_threads, (void*)ck_thread);
 
+    pin_thread(check_point_thread, ev_mgr->con_node->placement.checkpoint_core);
+    thread_placement_display(stderr, "check point", check_point_thread);
+
+    if (ev_mgr->check_output)
+    {
+        pthread_t *gd_thread = (pthread_t*)malloc(sizeof(pthread_t));
+        if (start_guard_client(gd_thread) != 0)
+        {
+            fprintf(stderr, "EVENT MANAGER : Cannot create guard client thread\n");
+            free(gd_thread);
+        }
+        else
+        {
+            listAddNodeTail(ev_mgr->excluded_threads, (void*)gd_thread);
+        }
+    }
+
+    if (ev_mgr->check_output && ev_mgr->output_hasher)
+    {
+        pthread_t *hs_thread = (pthread_t*)malloc(sizeof(pthread_t));
+        if (start_output_hasher(hs_thread, &ev_mgr->con_node->wait) != 0)
+        {
+            fprintf(stderr, "EVENT MANAGER : Cannot create output hasher thread\n");
+            free(hs_thread);
+        }
+        else
+        {
+            listAddNodeTail(ev_mgr->excluded_threads, (void*)hs_thread);
+            thread_placement_display(stderr, "output hasher", *hs_thread);
+        }
+    }
+
     return rc;
 }
 
+/* The fd number may have been a connection before; whatever that one left
+ * in the fd table goes. */
+static void reset_fd_state(int fd, fd_state* st)
+{
+    if (NULL != st->output)
+        del_output(fd);
+    st->role = FD_ROLE_NONE;
+    if (NULL != st->cls)
+    {
+        free(st->cls);
+        st->cls = NULL;
+    }
+}
+
+void mgr_on_socket(int fd, event_manager* ev_mgr)
+{
+    fd_state* st = fd_socket_open(fd);
+    if (NULL != st)
+        reset_fd_state(fd, st);
+}
+
 void mgr_on_accept(int fd, event_manager* ev_mgr)
 {
+    fd_state* st = fd_socket_open(fd);
+    if (NULL == st)
+        return;
+    reset_fd_state(fd, st);
+
     if (internal_threads(ev_mgr->excluded_threads, pthread_self()))
         return;
 
     uint32_t leader_id = get_leader_id(ev_mgr->con_node);
     if (ev_mgr->node_id == leader_id)
     {
-        leader_tcp_pair* new_conn = malloc(sizeof(leader_tcp_pair));
-        memset(new_conn,0,sizeof(leader_tcp_pair));
-
-        new_conn->key = fd;
-        HASH_ADD_INT(ev_mgr->leader_tcp_map, key, new_conn);
-
-        rsm_op(ev_mgr->con_node, 0, NULL, P_TCP_CONNECT, &new_conn->vs);
+        memset(&st->vs, 0, sizeof(view_stamp));
+        if (NULL != ev_mgr->classifier)
+            st->cls = calloc(1, sizeof(classify_state));
+
+        // every later request of this connection follows the shard in its view stamp
+        uint32_t shard = fd % get_shard_count(ev_mgr->con_node);
+        rsm_op(ev_mgr->con_node, shard, 0, NULL, P_TCP_CONNECT, &st->vs);
+        st->role = FD_ROLE_CLIENT;
     } else {
-        request_record* retrieve_data = NULL;
-        size_t data_size;
-    
-        while (retrieve_data == NULL){
-            retrieve_record(ev_mgr->db_ptr, sizeof(db_key_type), &ev_mgr->cur_rec, &data_size, (void**)&retrieve_data);
-        }
         replica_tcp_pair* ret = NULL;
-        HASH_FIND(hh, ev_mgr->replica_tcp_map, &retrieve_data->clt_id, sizeof(view_stamp), ret);
+        pthread_spin_lock(&ev_mgr->map_lock);
+        HASH_FIND(hh, ev_mgr->replica_tcp_map, &ev_mgr->connecting, sizeof(view_stamp), ret);
+        pthread_spin_unlock(&ev_mgr->map_lock);
         ret->s_p = fd;
         ret->accepted = 1;
+        st->role = FD_ROLE_REPLAY;
     }
 
     return;
@@ -109,104 +165,158 @@ void mgr_on_recvfrom(event_manager* ev_mgr, void* buf, ssize_t ret, struct socka
         leader_udp_pair *s;
         char tmp[14];
         strncpy(tmp, src_addr->sa_data, 14);
+        pthread_spin_lock(&ev_mgr->map_lock);
         HASH_FIND_STR(ev_mgr->leader_udp_map, tmp, s);
+        pthread_spin_unlock(&ev_mgr->map_lock);
         if (s == NULL)
         {
             leader_udp_pair* new_conn = malloc(sizeof(leader_udp_pair));
             memset(new_conn,0,sizeof(leader_udp_pair));
             strncpy(new_conn->sa_data, src_addr->sa_data, 14);
+            pthread_spin_lock(&ev_mgr->map_lock);
             HASH_ADD_STR(ev_mgr->leader_udp_map, sa_data, new_conn);
-            rsm_op(ev_mgr->con_node, 0, NULL, P_UDP_CONNECT, &new_conn->vs);
-            rsm_op(ev_mgr->con_node, ret, buf, P_SEND, &new_conn->vs);
+            pthread_spin_unlock(&ev_mgr->map_lock);
+            // udp peers have no fd of their own; they all go through shard 0
+            rsm_op(ev_mgr->con_node, 0, 0, NULL, P_UDP_CONNECT, &new_conn->vs);
+            rsm_op(ev_mgr->con_node, 0, ret, buf, P_SEND, &new_conn->vs);
         } else {
-            rsm_op(ev_mgr->con_node, ret, buf, P_SEND, &s->vs);
+            rsm_op(ev_mgr->con_node, VS_SHARD(&s->vs), ret, buf, P_SEND, &s->vs);
         }
     }
 }
 
 void mgr_on_close(int fd, event_manager* ev_mgr)
 {
+    fd_state* st = fd_state_get(fd);
+    if (NULL == st)
+        return;
+    if (FD_SOCKET != st->type) {
+        // the number may come back as a socket
+        st->type = FD_UNKNOWN;
+        return;
+    }
+    st->type = FD_UNKNOWN;
+    uint8_t role = st->role;
+    view_stamp close_vs = st->vs;
+    reset_fd_state(fd, st);
+
     if (internal_threads(ev_mgr->excluded_threads, pthread_self()))
         return;
     
-    del_output(fd);
     uint32_t leader_id = get_leader_id(ev_mgr->con_node);
-    if (ev_mgr->node_id == leader_id)
+    if (ev_mgr->node_id == leader_id && FD_ROLE_CLIENT == role)
     {
-        leader_tcp_pair* ret = NULL;
-        HASH_FIND_INT(ev_mgr->leader_tcp_map, &fd, ret);
-        if (ret == NULL)
-            goto mgr_on_close_exit;
-
-        view_stamp close_vs = ret->vs;
-        HASH_DEL(ev_mgr->leader_tcp_map, ret);
+        uint32_t shard = VS_SHARD(&close_vs);
 
-        rsm_op(ev_mgr->con_node, 0, NULL, P_CLOSE, &close_vs);
+        rsm_op(ev_mgr->con_node, shard, 0, NULL, P_CLOSE, &close_vs);
         // nop is only for sending the close() consensus result to the replicas.
-        rsm_op(ev_mgr->con_node, 0, NULL, P_NOP, NULL);
+        rsm_op(ev_mgr->con_node, shard, 0, NULL, P_NOP, NULL);
     }
-mgr_on_close_exit:
     return;
 }
 
-output_peer_t* prepare_peer_array(int fd, dare_log_entry_t *log_entry_ptr, uint32_t leader_id, long hash_index, uint32_t group_size){
-    
-    // because rsm_op() returns when it reaches quorum
-    
-    struct timespec wait_for_reply;
-    wait_for_reply.tv_sec = 0;
-    wait_for_reply.tv_nsec = 1000 * 5;
-    nanosleep(&wait_for_reply, NULL);
-    
-    output_peer_t* peer_array = (output_peer_t*)malloc(group_size * sizeof(output_peer_t));
+/* fd was made by dup(), dup2(), dup3() or fcntl(F_DUPFD); whatever dup2() or
+ * dup3() replaced at that number is closed, and the copy is checked like any
+ * other socket but keeps no role, as the original still owns the connection. */
+void mgr_on_dup(int fd, event_manager* ev_mgr)
+{
+    mgr_on_close(fd, ev_mgr);
+    fd_state_classify(fd);
+}
+
+/* Runs on the completion thread once the P_OUTPUT entry committed and every
+ * follower acked it, or OUTPUT_CHECK_TIMEOUT_US passed; each ack carries that
+ * follower's output hash. do_decision leaves out the hashes still missing. */
+static void decide_output(rsm_ticket* ticket, void* arg){
+    output_check* check = arg;
+    event_manager* ev_mgr = check->ev_mgr;
+    uint32_t group_size = get_group_size(ev_mgr->con_node);
+    uint32_t leader_id = check->peers[0].leader_id;
+    accept_ack ack;
     uint32_t i;
-    for (i = 0; i < group_size; i++){
-        peer_array[i].leader_id = leader_id;
-        peer_array[i].node_id = log_entry_ptr->ack[i].node_id;
-        peer_array[i].hash = log_entry_ptr->ack[i].hash;
-        peer_array[i].hash_index = hash_index;
-        peer_array[i].fd = -1;
+
+    for (i = 0; i < group_size; i++) {
+        if (i == leader_id)
+            continue;
+        if (0 == rsm_output_ack(ev_mgr->con_node, ticket->entry, i, &ack) && ack.has_hash) {
+            check->peers[i].hash = ack.hash;
+            check->peers[i].has_hash = 1;
+        }
+    }
+    // make decision about who needs to be restored based on the hash value.
+    do_decision(check->peers, group_size);
+    check->busy = 0;
+}
+
+/* Proposes the leader's hash of round hash_index without waiting for it; the
+ * peers are filled in by decide_output. */
+static void propose_output(int fd, event_manager* ev_mgr, uint32_t leader_id, long hash_index){
+    output_check* check = NULL;
+    uint32_t i;
+
+    for (i = 0; i < OUTPUT_CHECK_SLOTS; i++) {
+        if (0 == ev_mgr->output_checks[i].busy
+            && __sync_bool_compare_and_swap(&ev_mgr->output_checks[i].busy, 0, 1)) {
+            check = &ev_mgr->output_checks[i];
+            break;
+        }
+    }
+    if (NULL == check) {
+        debug_log("[propose_output] fd:%d, no free output check, round %ld is skipped\n", fd, hash_index);
+        return;
     }
 
-    peer_array[leader_id].hash = get_output_hash(fd, hash_index);
+    fd_state* st = fd_state_get(fd);
+    if (NULL == st || FD_ROLE_CLIENT != st->role) {
+        check->busy = 0;
+        return;
+    }
 
-    peer_array[leader_id].fd = fd;
-    return peer_array;
+    uint32_t group_size = get_group_size(ev_mgr->con_node);
+    for (i = 0; i < group_size; i++) {
+        check->peers[i].leader_id = leader_id;
+        check->peers[i].node_id = i;
+        // a peer whose ack does not arrive stays without a hash
+        check->peers[i].hash = 0;
+        check->peers[i].has_hash = 0;
+        check->peers[i].hash_index = hash_index;
+        check->peers[i].fd = -1;
+    }
+    check->peers[leader_id].has_hash = (0 == get_output_hash(fd, hash_index, &check->peers[leader_id].hash));
+    check->peers[leader_id].fd = fd;
+
+    check->ev_mgr = ev_mgr;
+    memset(&check->ticket, 0, sizeof(rsm_ticket));
+    check->ticket.cb = decide_output;
+    check->ticket.ack_wait_us = OUTPUT_CHECK_TIMEOUT_US;
+    check->ticket.cb_arg = check;
+    if (0 != rsm_op_async(ev_mgr->con_node, VS_SHARD(&st->vs), sizeof(long), &hash_index, P_OUTPUT, &st->vs, &check->ticket))
+        check->busy = 0;
 }
 
 void mgr_on_check(int fd, const void* buf, size_t ret, event_manager* ev_mgr)
 {
+    if (!ev_mgr->check_output)
+        return;
+    fd_state* st = fd_state_known(fd);
+    if (NULL == st || FD_SOCKET != st->type)
+        return;
     if (internal_threads(ev_mgr->excluded_threads, pthread_self()))
         return;
-    
-    if (ev_mgr->check_output)
-    {
-        int store_output_rc = 0;
-        store_output_rc = store_output(fd, buf, ret);
-        // if store_output() returns 0 or -1, return directly
-        if (store_output_rc <= 0){
-            return;
-        }
-        uint32_t leader_id = get_leader_id(ev_mgr->con_node);
-        if (leader_id == ev_mgr->node_id)
-        {
-            long hash_index = determine_output(fd); 
-            if (-1 != hash_index){
-                // do output proposal with hash value at this hash_index
-
-                leader_tcp_pair* socket_pair = NULL;
-                HASH_FIND_INT(ev_mgr->leader_tcp_map, &fd, socket_pair);
 
-                dare_log_entry_t *log_entry_ptr = rsm_op(ev_mgr->con_node, sizeof(long), &hash_index, P_OUTPUT, &socket_pair->vs);
-
-                uint32_t group_size = get_group_size(ev_mgr->con_node);
-
-                output_peer_t* peer_array = prepare_peer_array(fd, log_entry_ptr, leader_id, hash_index, group_size);
-                // make decision about who needs to be restored based on the hash value.
-
-                do_decision(peer_array, group_size);
-                free(peer_array);
-            }
+    int store_output_rc = 0;
+    store_output_rc = store_output(fd, buf, ret);
+    // if store_output() returns 0 or -1, return directly
+    if (store_output_rc <= 0){
+        return;
+    }
+    uint32_t leader_id = get_leader_id(ev_mgr->con_node);
+    if (leader_id == ev_mgr->node_id)
+    {
+        long hash_index = determine_output(fd, rsm_proposals(ev_mgr->con_node)); 
+        if (-1 != hash_index){
+            // do output proposal with hash value at this hash_index
+            propose_output(fd, ev_mgr, leader_id, hash_index);
         }
     }
 }
@@ -240,20 +350,42 @@ static int keep_alive(int fd) {
     return 0;
 }
 
+static void release_ticket(rsm_ticket* ticket, void* arg){
+    free(ticket);
+}
+
 void server_side_on_read(event_manager* ev_mgr, void *buf, size_t ret, int fd){
+    fd_state* st = fd_state_get(fd);
+    if (NULL == st || FD_ROLE_CLIENT != st->role || 0 == ev_mgr->rsm)
+        return;
     if (internal_threads(ev_mgr->excluded_threads, pthread_self()))
         return;
     
     uint32_t leader_id = get_leader_id(ev_mgr->con_node);
     if (ev_mgr->node_id == leader_id)
     {
-        struct stat sb;
-        fstat(fd, &sb);
-        if ((sb.st_mode & S_IFMT) == S_IFSOCK && ev_mgr->rsm != 0)
+        uint32_t shard = VS_SHARD(&st->vs);
+        // the classifier sees every read, so it keeps track of request boundaries
+        if (NULL != st->cls && ev_mgr->classifier->scan(st->cls, buf, ret)
+            && leader_lease_valid(ev_mgr->con_node))
+            return;
+        if (ev_mgr->async_rsm)
         {
-            leader_tcp_pair* socket_pair = NULL;
-            HASH_FIND_INT(ev_mgr->leader_tcp_map, &fd, socket_pair);
-            rsm_op(ev_mgr->con_node, ret, buf, P_SEND, &socket_pair->vs);
+            // the data is copied into the log on submission, so the read can return right away
+            rsm_ticket* ticket = (rsm_ticket*)malloc(sizeof(rsm_ticket));
+            if (NULL == ticket) {
+                err_log("EVENT MANAGER : Cannot Allocate A Ticket For fd %d.\n", fd);
+                return;
+            }
+            memset(ticket, 0, sizeof(rsm_ticket));
+            ticket->cb = release_ticket;
+            // a proposal that was not taken never hands the ticket back
+            if (0 != rsm_op_async(ev_mgr->con_node, shard, ret, buf, P_SEND, &st->vs, ticket)) {
+                free(ticket);
+                err_log("EVENT MANAGER : Cannot Propose The Read Of fd %d.\n", fd);
+            }
+        } else {
+            rsm_op(ev_mgr->con_node, shard, ret, buf, P_SEND, &st->vs);
         }
     }
     return;
@@ -262,13 +394,17 @@ void server_side_on_read(event_manager* ev_mgr, void *buf, size_t ret, int fd){
 static void do_action_close(view_stamp clt_id,void* arg){
     event_manager* ev_mgr = arg;
     replica_tcp_pair* ret = NULL;
+    pthread_spin_lock(&ev_mgr->map_lock);
     HASH_FIND(hh, ev_mgr->replica_tcp_map, &clt_id, sizeof(view_stamp), ret);
+    if(NULL!=ret){
+        HASH_DEL(ev_mgr->replica_tcp_map, ret);
+    }
+    pthread_spin_unlock(&ev_mgr->map_lock);
     if(NULL==ret){
         goto do_action_close_exit;
     }else{
         if (close(ret->p_s))
                 fprintf(stderr, "failed to close socket\n");
-        HASH_DEL(ev_mgr->replica_tcp_map, ret);
     }
 do_action_close_exit:
     return;
@@ -278,6 +414,7 @@ static void do_action_tcp_connect(view_stamp clt_id,void* arg){
     event_manager* ev_mgr = arg;
     replica_tcp_pair* ret;
 
+    pthread_spin_lock(&ev_mgr->map_lock);
     HASH_FIND(hh, ev_mgr->replica_tcp_map, &clt_id, sizeof(view_stamp), ret);
     if(NULL==ret){
         ret = malloc(sizeof(replica_tcp_pair));
@@ -286,6 +423,10 @@ static void do_action_tcp_connect(view_stamp clt_id,void* arg){
         ret->accepted = 0;
         HASH_ADD(hh, ev_mgr->replica_tcp_map, key, sizeof(view_stamp), ret);
     }
+    pthread_spin_unlock(&ev_mgr->map_lock);
+
+    pthread_mutex_lock(&ev_mgr->connect_lock);
+    ev_mgr->connecting = clt_id;
 
     int fd = socket(AF_INET, SOCK_STREAM, 0);
 
@@ -301,6 +442,7 @@ static void do_action_tcp_connect(view_stamp clt_id,void* arg){
         printf("TCP_NODELAY SETTING ERROR!\n");
     keep_alive(fd);
     while (!ret->accepted);
+    pthread_mutex_unlock(&ev_mgr->connect_lock);
 
     return;
 }
@@ -309,6 +451,7 @@ static void do_action_udp_connect(view_stamp clt_id,void* arg){
     event_manager* ev_mgr = arg;
     replica_tcp_pair* ret;
 
+    pthread_spin_lock(&ev_mgr->map_lock);
     HASH_FIND(hh, ev_mgr->replica_tcp_map, &clt_id, sizeof(view_stamp), ret);
     if(NULL==ret){
         ret = malloc(sizeof(replica_tcp_pair));
@@ -317,6 +460,7 @@ static void do_action_udp_connect(view_stamp clt_id,void* arg){
         ret->accepted = 0;
         HASH_ADD(hh, ev_mgr->replica_tcp_map, key, sizeof(view_stamp), ret);
     }
+    pthread_spin_unlock(&ev_mgr->map_lock);
     int fd = socket(AF_INET, SOCK_DGRAM, 0);
 
     connect(fd, (struct sockaddr*)&ev_mgr->sys_addr.s_addr,ev_mgr->sys_addr.s_sock_len);
@@ -332,7 +476,9 @@ static void do_action_udp_connect(view_stamp clt_id,void* arg){
 static void do_action_send(request_record *retrieve_data,void* arg){
     event_manager* ev_mgr = arg;
     replica_tcp_pair* ret = NULL;
+    pthread_spin_lock(&ev_mgr->map_lock);
     HASH_FIND(hh, ev_mgr->replica_tcp_map, &retrieve_data->clt_id, sizeof(view_stamp), ret);
+    pthread_spin_unlock(&ev_mgr->map_lock);
 
     if(NULL==ret){
         goto do_action_send_exit;
@@ -393,7 +539,9 @@ static void check_point_condtion(void* arg)
 {
     if (checkpoint_flag == DISCONNECTED_REQUEST) {
         event_manager* ev_mgr = arg;
+        pthread_spin_lock(&ev_mgr->map_lock);
         unsigned int connection_num = HASH_COUNT(ev_mgr->replica_tcp_map);
+        pthread_spin_unlock(&ev_mgr->map_lock);
         if (connection_num == 0)
         {
             checkpoint_flag = DISCONNECTED_APPROVE;
@@ -415,18 +563,27 @@ static int get_mapping_fd(view_stamp clt_id, void*arg)
 
     replica_tcp_pair* ret;
 
+    pthread_spin_lock(&ev_mgr->map_lock);
     HASH_FIND(hh, ev_mgr->replica_tcp_map, &clt_id, sizeof(view_stamp), ret);
+    pthread_spin_unlock(&ev_mgr->map_lock);
     return ret->s_p;
 }
 
-static void update_state(db_key_type index,void* arg){
-    event_manager* ev_mgr = arg;
+static void apply_record(request_record* retrieve_data,void* arg);
 
-    request_record* retrieve_data = NULL;
-    size_t data_size;
+static void do_action_batch(request_record* batch_data,void* arg){
+    size_t offset = 0;
+    size_t batch_size = batch_data->data_size - 1;
+    while(offset < batch_size){
+        request_record* sub_record = (request_record*)(batch_data->data + offset);
+        apply_record(sub_record,arg);
+        offset += BATCH_SUB_RECORD_SIZE(sub_record);
+    }
+    return;
+}
 
-    retrieve_record(ev_mgr->db_ptr, sizeof(index), &index, &data_size, (void**)&retrieve_data);
-    ev_mgr->cur_rec = index;
+static void apply_record(request_record* retrieve_data,void* arg){
+    event_manager* ev_mgr = arg;
 
     FILE* output = NULL;
     if(ev_mgr->req_log){
@@ -462,12 +619,38 @@ static void update_state(db_key_type index,void* arg){
                 fprintf(output,"Operation: NOP.\n");
             }
             break; // nop is only for sending the close() consensus result to the replicas
+        case P_BATCH:
+            if(output!=NULL){
+                fprintf(output,"Operation: Batch.\n");
+            }
+            do_action_batch(retrieve_data,arg);
+            break;
         default:
             break;
     }
     return;
 }
 
+static void update_state(db_key_type index,void* record,void* arg){
+    event_manager* ev_mgr = arg;
+
+    request_record* retrieve_data = record;
+    size_t data_size;
+
+    if(NULL!=retrieve_data){
+        apply_record(retrieve_data,arg);
+        return;
+    }
+    // the entry left the log already; the db has a copy of its own
+    if(0!=retrieve_record(ev_mgr->db_ptr, sizeof(index), &index, &data_size, (void**)&retrieve_data) || NULL==retrieve_data){
+        err_log("EVENT MANAGER : Record %"PRIu64" Is Missing, It Is Skipped.\n", (uint64_t)index);
+        return;
+    }
+    apply_record(retrieve_data,arg);
+    free(retrieve_data);
+    return;
+}
+
 
 event_manager* mgr_init(node_id_t node_id, const char* config_path, const char* log_path, const char* start_mode){
     
@@ -523,16 +706,17 @@ event_manager* mgr_init(node_id_t node_id, const char* config_path, const char*
             }
     }
 
-    ev_mgr->db_ptr = initialize_db(ev_mgr->db_name,0);
+    ev_mgr->db_ptr = initialize_db(ev_mgr->db_name,0,ev_mgr->durability);
 
     if(ev_mgr->db_ptr==NULL){
         err_log("EVENT MANAGER : Cannot Set Up The Database.\n");
         goto mgr_exit_error;
     }
 
-    ev_mgr->leader_tcp_map = NULL;
     ev_mgr->replica_tcp_map = NULL;
     ev_mgr->leader_udp_map = NULL;
+    pthread_spin_init(&ev_mgr->map_lock, PTHREAD_PROCESS_PRIVATE);
+    pthread_mutex_init(&ev_mgr->connect_lock, NULL);
 
     ev_mgr->con_node = system_initialize(&ev_mgr->node_id,config_path,log_path,update_state,check_point_condtion,get_mapping_fd,ev_mgr->db_ptr,ev_mgr,start_mode);
 
@@ -6,6 +6,8 @@
 typedef struct accept_ack_t{
     view_stamp msg_vs;
     node_id_t node_id;
+    view_stamp durable;     // every entry up to here is persistent on the sender
+    uint32_t has_hash;      // P_OUTPUT: the sender had the hash of the round
 
     uint64_t hash;
 }accept_ack;
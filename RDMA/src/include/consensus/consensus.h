@@ -2,6 +2,7 @@
 
 #define CONSENSUS_H
 #include "../util/common-header.h"
+#include "../util/wait.h"
 #include "../rdma/dare_log.h"
 #include "../output/output.h"
 
@@ -9,21 +10,70 @@ typedef uint64_t db_key_type;
 struct node_t;
 struct consensus_component_t;
 
-typedef void (*user_cb)(db_key_type index,void* arg);
+// record is the committed request_record in the log, or NULL if it has to come from the db
+typedef void (*user_cb)(db_key_type index,void* record,void* arg);
 typedef void (*up_check)(void* arg);
 typedef int (*up_get)(view_stamp clt_id, void* arg);
 
+// independent consensus instances; each one owns the top bits of its view ids,
+// so view stamps (and the db keys made from them) never collide across shards
+#define MAX_SHARD_COUNT 16
+#define SHARD_VIEW_SHIFT 24
+#define SHARD_VIEW_BITS(s) ((view_id_t)(s) << SHARD_VIEW_SHIFT)
+#define VS_SHARD(vs) ((vs)->view_id >> SHARD_VIEW_SHIFT)
+
 typedef enum con_role_t{
     LEADER = 0,
     SECONDARY = 1,
 }con_role;
 
-struct consensus_component_t* init_consensus_comp(struct node_t*,uint32_t*,FILE*,int,int,
+// how long a proposal waits for room in the log or the commit ring, which a
+// follower that stays behind holds back, before it fails
+#define PROPOSE_TIMEOUT_NS 1000000000ULL
+
+// upper bounds config-comp accepts for the batch settings
+#define BATCH_MAX_WINDOW_US 10000
+#define BATCH_MAX_BYTES (1 << 20)
+#define BATCH_MAX_COUNT 4096
+
+typedef struct batch_config_t{
+    int on;
+    uint32_t window_us;  // seal the batch once it is this old, even if proposals keep coming
+    uint32_t max_bytes;  // seal the batch once its sub-records reach this size
+    uint32_t max_count;  // seal the batch once it holds this many sub-records
+}batch_config;
+
+struct rsm_ticket_t;
+typedef void (*rsm_done_cb)(struct rsm_ticket_t* ticket, void* arg);
+
+// handle of an asynchronous proposal; if cb is set, the ticket belongs to cb once it fires.
+// A batched P_SEND fires with entry NULL if its batch could not be proposed.
+typedef struct rsm_ticket_t{
+    view_stamp vs;
+    dare_log_entry_t* entry;
+    volatile int done;
+    // P_OUTPUT: once committed, wait up to this long for every follower's output ack
+    uint32_t ack_wait_us;
+    uint64_t ack_deadline;
+    rsm_done_cb cb;
+    void* cb_arg;
+    struct rsm_ticket_t* next;
+}rsm_ticket;
+
+struct consensus_component_t* init_consensus_comp(struct node_t*,uint32_t,uint32_t*,FILE*,int,int,
         const char*,void*,int,
         view*,view_stamp*,view_stamp*,view_stamp*,user_cb,up_check,up_get,void*);
 
 dare_log_entry_t* leader_handle_submit_req(struct consensus_component_t*,size_t,void*,uint8_t,view_stamp*);
 
+int leader_submit_req_async(struct consensus_component_t*,size_t,void*,uint8_t,view_stamp*,rsm_ticket*);
+int consensus_completion_fd(struct consensus_component_t*);
+int leader_output_ack(struct consensus_component_t*,dare_log_entry_t*,uint32_t,accept_ack*);
+
+void recover_consensus_comp(struct consensus_component_t*);
+
 void *handle_accept_req(void* arg);
+void *handle_completion(void* arg);
+void *handle_persistence(void* arg);
 
 #endif
\ No newline at end of file
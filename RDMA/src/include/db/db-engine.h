@@ -0,0 +1,27 @@
+#ifndef DB_ENGINE_H
+#define DB_ENGINE_H
+#include "db-interface.h"
+
+/* A storage engine behind db-interface.h. The db_name prefix picks the
+ * engine, which gets the rest of the name; an engine without a prefix takes
+ * every other name. */
+typedef struct db_engine_t{
+    const char* name;
+    const char* prefix;
+    void* (*open)(const char* name,uint32_t flag,durability mode);
+    void (*close)(void* handle,uint32_t flag);
+    int (*put)(void* handle,size_t key_size,void* key,size_t data_size,void* data);
+    // *data is malloc'ed; the caller is responsible to release it
+    int (*get)(void* handle,size_t key_size,void* key,size_t* data_size,void** data);
+    // everything put so far to disk; only called with fsync-per-batch
+    int (*sync)(void* handle);
+    void (*stat)(void* handle,db_stat* stat);
+}db_engine;
+
+extern const db_engine bdb_engine;
+extern const db_engine wal_engine;
+extern const db_engine mem_engine;
+
+uint64_t db_now_ns();
+
+#endif
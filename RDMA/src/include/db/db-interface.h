@@ -1,11 +1,31 @@
 #ifndef DB_INTERFACE_H
 #define DB_INTERFACE_H
+#include <stdio.h>
 #include <stdint.h>
 #include <sys/types.h>
 
 typedef struct db_t db;
 
-db* initialize_db(const char* db_name,uint32_t flag);
+/* when a stored record is on disk */
+typedef enum durability_t{
+    DURABLE_NONE = 0,   // whenever the OS writes it back
+    DURABLE_ASYNC,      // within a flush interval, written by a background flusher
+    DURABLE_BATCH,      // at the next sync_db, one sync for everything stored before it
+    DURABLE_RECORD,     // before store_record returns
+}durability;
+
+typedef struct db_stat_t{
+    uint64_t syncs;         // fsync, fdatasync or msync calls
+    uint64_t flushes;       // times buffered records were made durable
+    uint64_t flush_ns;      // spent in the flushes
+    uint64_t max_flush_ns;
+}db_stat;
+
+int durability_parse(const char* name, durability* mode);
+const char* durability_name(durability mode);
+
+// "wal:<dir>" and "mem:<name>" pick those engines, any other name is a BerkeleyDB file
+db* initialize_db(const char* db_name,uint32_t flag,durability mode);
 
 void close_db(db*,uint32_t);
 
@@ -15,4 +35,15 @@ int store_record(db*,size_t,void*,size_t,void*);
 
 int retrieve_record(db*,size_t,void*,size_t*,void**);
 
-#endif
\ No newline at end of file
+// makes every record stored so far durable; only fsync-per-batch has to call it
+int sync_db(db*);
+
+durability db_durability(db*);
+
+const char* db_engine_name(db*);
+
+void db_stat_add(db_stat* stat, uint64_t syncs, uint64_t ns);
+void db_stat_get(db*, db_stat*);
+void db_stat_display(FILE* output, const char* name, db_stat* stat);
+
+#endif
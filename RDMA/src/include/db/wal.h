@@ -0,0 +1,28 @@
+#ifndef WAL_H
+#define WAL_H
+#include <stdint.h>
+#include <sys/types.h>
+#include "db-interface.h"
+
+/* Append-only write-ahead log of records keyed by a 64-bit key (a view
+ * stamp). Records go to preallocated segment files under one directory and
+ * are written out in batches; the durability mode decides who writes them
+ * and whether an fdatasync follows: a flusher thread every wal_flush_us
+ * (none, async-flush), wal_sync (fsync-per-batch) or wal_append itself
+ * (fsync-per-record). */
+typedef struct wal_t wal;
+
+wal* wal_open(const char* dir,durability mode);
+
+void wal_close(wal*);
+
+int wal_append(wal*,uint64_t,size_t,void*);
+
+// *data is malloc'ed; the caller is responsible to release it
+int wal_get(wal*,uint64_t,size_t*,void**);
+
+int wal_sync(wal*);
+
+void wal_stat_get(wal*,db_stat*);
+
+#endif
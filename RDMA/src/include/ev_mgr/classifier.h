@@ -0,0 +1,36 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include "../util/common-header.h"
+
+#define CLASSIFY_LINE_MAX 64
+
+/* Per-connection parse state. A classifier follows the request framing of
+ * its protocol across reads, so that it knows where requests start. */
+typedef struct classify_state_t{
+    int lost;           // framing lost; nothing on this connection is read-only any more
+    int state;
+    size_t skip;        // payload bytes still to pass over
+    int args;           // arguments left in the current request
+    int is_read;        // the current request is read-only
+    size_t line_len;
+    char line[CLASSIFY_LINE_MAX];
+}classify_state;
+
+typedef struct classifier_t{
+    const char* name;
+    /* Feeds the next len bytes read from a connection. Returns 1 if they are
+     * made of complete read-only requests only, 0 otherwise. */
+    int (*scan)(classify_state* st, const char* buf, size_t len);
+}classifier;
+
+extern const classifier redis_classifier;
+extern const classifier memcached_classifier;
+
+const classifier* find_classifier(const char* name);
+
+// helpers for the protocol parsers
+int classify_line_add(classify_state* st, char c);
+int classify_word_is(const char* word, size_t len, const char* const* names);
+
+#endif
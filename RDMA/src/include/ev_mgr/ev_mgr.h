@@ -4,18 +4,13 @@
 #include "../util/common-header.h"
 #include "../rsm-interface.h"
 #include "../replica-sys/replica.h"
+#include "./classifier.h"
 #include "uthash.h"
 
 typedef uint32_t nid_t;
 
 struct event_manager_t;
 
-typedef struct leader_tcp_pair_t{
-    int key;
-    view_stamp vs;
-    UT_hash_handle hh;
-}leader_tcp_pair;
-
 typedef struct leader_udp_pair_t{
     char sa_data[14];
     view_stamp vs;
@@ -30,6 +25,19 @@ typedef struct replica_tcp_pair_t{
     UT_hash_handle hh;
 }replica_tcp_pair;
 
+// output checks the leader can have in flight; a check finding none free is skipped
+#define OUTPUT_CHECK_SLOTS 16
+// how long a committed check waits for the hashes of the followers outside the quorum
+#define OUTPUT_CHECK_TIMEOUT_US 200
+
+// A P_OUTPUT proposal on its way; the ticket callback makes the decision.
+typedef struct output_check_t{
+    rsm_ticket ticket;
+    struct event_manager_t* ev_mgr;
+    volatile int busy;
+    output_peer_t peers[MAX_SERVER_COUNT];
+}output_check;
+
 typedef struct mgr_address_t{
     struct sockaddr_in s_addr;
     size_t s_sock_len;
@@ -37,7 +45,6 @@ typedef struct mgr_address_t{
 
 typedef struct event_manager_t{
     nid_t node_id;
-    leader_tcp_pair* leader_tcp_map;
     replica_tcp_pair* replica_tcp_map;
     leader_udp_pair* leader_udp_map;
     mgr_address sys_addr;
@@ -49,12 +56,26 @@ typedef struct event_manager_t{
     int req_log;
 
     int check_output;
+    // hash the output on a thread of its own instead of the writer's
+    int output_hasher;
     int rsm;
-
-    db_key_type cur_rec;
+    int async_rsm;
+    // marks read-only requests, which skip consensus while the leader holds its lease
+    const classifier* classifier;
+    // when the records of committed requests reach the disk
+    durability durability;
+
+    // replica threads of all shards share the maps
+    pthread_spinlock_t map_lock;
+    // a follower connects to the server for one client at a time, so that
+    // mgr_on_accept knows which client the accepted socket belongs to
+    pthread_mutex_t connect_lock;
+    view_stamp connecting;
 
     list *excluded_threads;
 
+    output_check output_checks[OUTPUT_CHECK_SLOTS];
+
     struct node_t* con_node;
 
     FILE* req_log_file;
@@ -71,6 +92,7 @@ typedef enum mgr_action_t{
     P_OUTPUT=4,
     P_NOP=5,
     P_UDP_CONNECT=6,
+    P_BATCH=7,
 }mgr_action;
 
 typedef enum check_point_state_t{
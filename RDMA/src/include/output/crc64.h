@@ -3,6 +3,17 @@
 
 #include <stdint.h>
 
+/* crc-64-jones, as Redis has it; picks its implementation at first use */
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 
+/* the implementations crc64 picks from, all bit-identical */
+void crc64_setup(void);
+const char *crc64_impl_name(void);
+uint64_t crc64_bytewise(uint64_t crc, const unsigned char *s, uint64_t l);
+uint64_t crc64_slice8(uint64_t crc, const unsigned char *s, uint64_t l);
+uint64_t crc64_slice16(uint64_t crc, const unsigned char *s, uint64_t l);
+int crc64_pclmul_supported(void);
+// falls back to slice-by-16 where PCLMULQDQ is missing
+uint64_t crc64_pclmul(uint64_t crc, const unsigned char *s, uint64_t l);
+
 #endif
@@ -9,12 +9,28 @@ Description: Output hash value implementation.
 
 #include "adlist.h"
 #include "../util/common-header.h"
+#include "../util/wait.h"
+#include "../util/fd-table.h"
 
+// determine_output calls per fd between checks, right after a divergence
 #define CHECK_PERIOD 10
 #define CHECK_GOBACK 5
 #define HASH_BUFFER_SIZE 1024
-// since max tcp port number will not exceed this number
-#define MAX_FD_SIZE 65536 
+// hashes kept per connection by default; older rounds cannot be checked
+#define OUTPUT_WINDOW 64
+// handlers allocated at once
+#define OUTPUT_SLAB_SIZE 64
+// bytes of output a connection can have waiting for the hasher thread
+#define OUTPUT_STREAM_SIZE (64 * 1024)
+
+// Output on its way from the connection's writer to the hasher thread; a
+// single-producer single-consumer byte ring, its buffer from a shared pool.
+typedef struct output_stream_t
+{
+	unsigned char* data;
+	volatile uint64_t head; // bytes the writer put in
+	volatile uint64_t tail; // bytes the hasher took out
+}output_stream_t;
 
 // [TODO] The design of output_handler_t shoud be reviewed by cheng.
 // I do not this this structure should be protected by lock.
@@ -22,19 +38,52 @@ typedef struct output_handler_t
 {
 	// This output_handler will belong to this fd.
 	int fd;
-	// The length of the output_list. once a hash value is pushed, the count will be increased.
-	long count; 
-	list *output_list;
-	// The last hash value in the output_list.
+	// How many hash values were generated; round r is at hash_ring[r % window].
+	// With the hasher thread, rounds count as generated once it published them.
+	volatile long count; 
+	// The last output_window hash values.
+	uint64_t *hash_ring;
+	long window;
+	// The last hash value generated.
 	uint64_t hash; 
-	// Once this hash_buffer is filled full, a hash value will be pushed into output_list.
-	unsigned char hash_buffer[HASH_BUFFER_SIZE];
-	// The current water mark of the hash_buffer.
-	int hash_buffer_curr;
+	// The CRC of the output so far, up to the middle of the current round;
+	// once HASH_BUFFER_SIZE bytes are in, it becomes the round's hash value.
+	uint64_t round_crc;
+	// How many bytes of the current round went into round_crc.
+	int round_bytes;
 	// how many times a determine_output(fd) was called.
 	long called_cnt;
+	// called_cnt at the last check of this fd.
+	long checked_cnt;
+	// With the hasher thread: the output not hashed yet, the rounds store_output
+	// already reported, and whether del_output left the handler to the hasher.
+	output_stream_t* stream;
+	long reported;
+	volatile int closing;
+	struct output_handler_t* next_active;
 }output_handler_t;
 
+// How often output is checked. The period starts at min_period and doubles
+// after every backoff_after checks in a row found the replicas agreeing, up to
+// max_period; a divergence brings it back to min_period. Checks stay below
+// max_share of all the proposals; 1 lifts the cap.
+typedef struct check_policy_t
+{
+	long min_period;
+	long max_period;
+	long backoff_after;
+	double max_share;
+}check_policy;
+
+typedef struct check_stat_t
+{
+	uint64_t checks;    // rounds proposed for a check
+	uint64_t capped;    // checks put off by max_share
+	uint64_t agreed;    // decisions finding all hashes the same
+	uint64_t diverged;  // decisions having nodes restored
+	long period;        // current period
+}check_stat;
+
 // [TODO] This data structure should be reviewed by Cheng
 typedef struct output_peer_t
 {
@@ -42,46 +91,63 @@ typedef struct output_peer_t
 	uint32_t leader_id; // will be removed
 	uint32_t node_id;
 	uint64_t hash;
+	int has_hash; // the node's hash arrived; otherwise hash means nothing
 	long hash_index;
 	int fd; // fd is needed because I will print the content of hash_buff if hash is different.
 	// but currently, only leader's fd is avaiable.
 }output_peer_t;
 
 
-typedef struct output_manager_t{
-	output_handler_t* fd_handler[MAX_FD_SIZE];
-}output_manager_t;
-
-
-// return an instance of output_mgr
-output_manager_t * get_output_mgr(); 
-
 // [TODO] I need ask Cheng when this function is called to init output manager
 // init_output_mgr() is required to be called in one thread.
 void init_output_mgr();
 // deinit_output_mgr is required to be called at the same thread where init_output_mgr is called.
 void deinit_output_mgr();
 
+// Moves hashing off the writers' threads onto a hasher thread, for the
+// connections opened from now on; store_output then only queues the bytes.
+// The hasher waits for work as cfg says. 0 is ok, -1 is error
+int start_output_hasher(pthread_t* thread, const wait_config* cfg);
+
+// how many hash values a connection keeps; set it before the first connection.
+// It must exceed CHECK_GOBACK, or determine_output proposes rounds already gone.
+void set_output_window(long window);
+
 
 output_handler_t* get_output_handler_by_fd(int fd);
 
-// It will return the number of hash value were putted into the output_list.
-// 0 means the input buff is too small to fill the hash_buffer,
-// so that no hash value is putted into output_list.
+// It will return the number of hash value were putted into the hash_ring.
+// 0 means the input buff is too small to complete a round,
+// so that no hash value is putted into hash_ring.
 int store_output(int fd, const unsigned char *buf, ssize_t ret);
 
 // decide whether the leader needs to call rsm_op to do output conconsistency
 // return the index of hashvalue in a certain connection(fd).
 // if -1 is returned, means do not do output conconsistency.
-long determine_output(int fd);
+// proposals is how many entries the leader proposed, for the max_share cap.
+long determine_output(int fd, uint64_t proposals);
+
+// 0 is ok, -1 is error
+int set_check_policy(const check_policy* policy);
+void get_check_policy(check_policy* policy);
+// do_decision reports every decision it made, so the period can adapt
+void check_policy_update(int diverged);
+void check_stat_get(check_stat* stat);
+void check_stat_display(FILE* output);
 
 // make decision about who need to be restored based on the hash value.
 // peer_array stores hash value and node_id
 int do_decision(output_peer_t* peer_array, int group_size);
 
-// return hashvalue at posistion hash_index
-// If it is impossible to get hash value, 0 will be returned as default value.
-uint64_t get_output_hash(int fd, long hash_index);
+// Starts the thread that passes restore commands on to guard.py; until it
+// runs, do_decision cannot have nodes restored.
+// 0 is ok, -1 is error
+int start_guard_client(pthread_t* thread);
+
+// put the hashvalue at posistion hash_index into *hash
+// 0 is ok, -1 if it is impossible to get hash value (not generated yet, or
+// older than the window); any value is a valid hash.
+int get_output_hash(int fd, long hash_index, uint64_t* hash);
 
 // Once a fd is closed the output data structure should be freed.
 // 0 is ok, -1 is error
@@ -91,8 +157,6 @@ int del_output(int fd);
 // private used
 // declear
 
-void init_fd_handler(output_manager_t *output_mgr);
-int deinit_fd_handler(output_manager_t *output_mgr);
 
 output_handler_t* new_output_handler(int fd);
 void delete_output_handler(output_handler_t* ptr);
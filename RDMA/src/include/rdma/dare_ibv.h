@@ -26,6 +26,13 @@ typedef struct rc_qp_t rc_qp_t;
 
 struct rc_cq_t {
     struct ibv_cq *cq;          // RC QP
+    /* The HB writes and the other writes share the CQ; whoever polls it
+     * files each completion here, for the thread that waits for it */
+    pthread_mutex_t lock;
+    uint64_t hb_done;           // wr_id of the newest HB completion
+    int hb_status;
+    uint32_t others;            // other completions nobody claimed yet
+    int other_status;           // first failed one among them, IBV_WC_SUCCESS if none
 }; 
 typedef struct rc_cq_t rc_cq_t;
 
@@ -82,7 +89,7 @@ int dare_ib_join_cluster();
 /* */
 int find_max_inline(struct ibv_context *context, struct ibv_pd *pd, uint32_t *max_inline_arg );
 
-int dare_ib_send_hb();
+int dare_ib_send_hb(uint32_t *acked, uint64_t wait_ns);
 
 /* Leader election */
 int dare_ib_send_vote_request();
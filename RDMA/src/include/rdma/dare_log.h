@@ -1,9 +1,11 @@
 #ifndef DARE_LOG_H
 #define DARE_LOG_H
 
+#include <sys/mman.h>
 #include "dare.h"
 #include "dare_config.h"
 #include "../util/common-structure.h"
+#include "../util/placement.h"
 #include "../consensus/consensus-msg.h"
 
 struct vote_req_t {
@@ -13,18 +15,34 @@ struct vote_req_t {
 };
 typedef struct vote_req_t vote_req_t;
 
+/* bumped whenever the entry layout changes; followers refuse other versions */
+#define LOG_ENTRY_VERSION 2
+
+/* The fields from data_size on are laid out exactly like request_record,
+ * so that an entry is stored in the db straight from the log. Acks are not
+ * part of the entry; followers write them to ctrl_data.ack of the leader. */
 struct dare_log_entry_t{
-    accept_ack ack[MAX_SERVER_COUNT];
+    uint8_t version;
+    uint8_t node_id;
+    uint16_t reserved;
     view_stamp msg_vs;
     view_stamp req_canbe_exed;
-    node_id_t node_id;
-    size_t data_size;
+    uint32_t data_size;
     uint8_t type;
     view_stamp clt_id;
     char data[0];
-}; // 168bytes
+}; // 36bytes
 typedef struct dare_log_entry_t dare_log_entry_t;
 
+#define OUTPUT_ACK_RING 64
+
+/* where a follower acks the leader's entries */
+struct ack_area_t {
+    accept_ack last;                        /* newest ack; it covers every entry up to last.msg_vs */
+    accept_ack output[OUTPUT_ACK_RING];     /* acks of P_OUTPUT entries, by req_id, with the output hash */
+};
+typedef struct ack_area_t ack_area_t;
+
 struct ctrl_data_t {
     /* State identified (SID) */
     uint64_t    sid;
@@ -33,6 +51,8 @@ struct ctrl_data_t {
     vote_req_t    vote_req[MAX_SERVER_COUNT];       /* vote requests */
     uint64_t      hb[MAX_SERVER_COUNT];             /* heartbeat array */ 
     uint64_t      vote_ack[MAX_SERVER_COUNT];
+    uint64_t      read[MAX_SERVER_COUNT];           /* followers' read counters */
+    ack_area_t    ack[MAX_SERVER_COUNT];            /* followers' acks */
 };
 typedef struct ctrl_data_t ctrl_data_t;
 
@@ -40,9 +60,13 @@ typedef struct ctrl_data_t ctrl_data_t;
 
 struct dare_log_t
 {
-    uint64_t head;
-    uint64_t read;
-    uint64_t write;
+    /* head, read and write count bytes since the log was created, including
+     * the bytes skipped when an entry wraps to the start of the buffer */
+    uint64_t head;  /* leader: every follower has read this far */
+    uint64_t read;  /* follower: bytes taken off the log, once applied */
+    uint64_t write; /* leader: bytes handed out to entries */
+    uint64_t accepted;  /* follower: bytes accepted, but maybe not applied yet */
+    uint64_t durable;   /* bytes on disk, when the log is backed by a file */
     uint64_t end;  /* offset after the last entry; 
                     if end==len the buffer is empty;
                     if end==head the buffer is full */
@@ -50,6 +74,9 @@ struct dare_log_t
                     Note: tail + sizeof(last_entry) == end */
     
     uint64_t len;
+    uint64_t version;   /* LOG_ENTRY_VERSION of the entries */
+
+    accept_ack reply;   /* follower: source buffer of its acks */
 
     ctrl_data_t ctrl_data;    
     uint8_t entries[0];
@@ -59,38 +86,118 @@ typedef struct dare_log_t dare_log_t;
 /* ================================================================== */
 /* Static functions to handle the log */
 
-static dare_log_t* log_new()
+/* Shards share one registered region: shard s keeps its own dare_log_t
+ * header and entries at log_shard_offset(log, s). Only shard 0's ctrl_data
+ * is used, for elections and heartbeats. */
+static inline uint64_t log_shard_offset(dare_log_t* log, uint32_t shard)
+{
+    return (uint64_t)shard * (sizeof(dare_log_t) + log->len);
+}
+
+static inline dare_log_t* log_shard(dare_log_t* log, uint32_t shard)
+{
+    return (dare_log_t*)((char*)log + log_shard_offset(log, shard));
+}
+
+static inline uint64_t log_region_size(dare_log_t* log, uint32_t shards)
+{
+    return log_shard_offset(log, shards);
+}
+
+static void log_init(dare_log_t* log, uint32_t shards, uint64_t len)
 {
-    dare_log_t* log = (dare_log_t*)malloc(sizeof(dare_log_t)+LOG_SIZE);
+    uint32_t i;
+    memset(log, 0, shards * (sizeof(dare_log_t) + len));
+    log->len = len;
+    for (i = 0; i < shards; i++) {
+        dare_log_t* shard = log_shard(log, i);
+        shard->len  = len;
+        shard->end  = shard->len;
+        shard->tail = shard->len;
+        shard->version = LOG_ENTRY_VERSION;
+    }
+}
+
+/* With a path, the log is a shared mapping of that file, which keeps the
+ * entries on disk; a file left by an earlier run with the same layout is
+ * kept as it is, for the replica threads to recover from. */
+static dare_log_t* log_new(int numa_node, uint32_t shards, uint64_t log_size, const char* path)
+{
+    uint64_t len = (log_size / shards) & ~((uint64_t)7);
+    uint64_t size = shards * (sizeof(dare_log_t) + len);
+    int existed = 0;
+
+    dare_log_t* log;
+    if (NULL != path)
+        log = (dare_log_t*)numa_map_file(path, size, numa_node, &existed);
+    else
+        log = (dare_log_t*)numa_alloc(size, numa_node);
     if (NULL == log) {
         rdma_error(log_fp, "Cannot allocate log memory\n");
         return NULL;
     }    
-    /* Initialize log offsets */
-    memset(log, 0, sizeof(dare_log_t)+LOG_SIZE);
-    log->len  = LOG_SIZE;
-    log->end  = log->len;
-    log->tail = log->len;
+    if (!existed || log->len != len || log->version != LOG_ENTRY_VERSION) {
+        if (existed)
+            rdma_error(log_fp, "The log file %s has another layout; starting it over\n", path);
+        log_init(log, shards, len);
+    }
 
     return log;
 }
 
-static void log_free(dare_log_t* log)
+static void log_free(dare_log_t* log, uint32_t shards)
 {
     if (NULL != log) {
-        free(log);
+        numa_free(log, log_region_size(log, shards));
         log = NULL;
     }
 }
 
+/* bytes a log file should hold: the leader's entries or the follower's */
+static inline uint64_t log_sync_target(dare_log_t* log)
+{
+    return (log->write > log->accepted) ? log->write : log->accepted;
+}
+
+/* Writes back the entries up to the byte counter target (head, read, write
+ * or accepted) and then durable itself; the log must be a file mapping.
+ * Callers may race, so durable only ever moves forward. */
+static int log_sync(dare_log_t* log, uint64_t target)
+{
+    uint64_t from = log->durable, seen;
+    uintptr_t start, stop, page = (uintptr_t)PAGE_SIZE - 1;
+
+    if (target <= from)
+        return 0;
+    if (target - from >= log->len)
+        from = target - log->len;
+    while (from < target) {
+        uint64_t off = from % log->len;
+        uint64_t n = log->len - off;
+        if (n > target - from)
+            n = target - from;
+        start = (uintptr_t)(log->entries + off) & ~page;
+        stop = (uintptr_t)(log->entries + off + n);
+        if (0 != msync((void*)start, stop - start, MS_SYNC))
+            return 1;
+        from += n;
+    }
+    while ((seen = log->durable) < target && !__sync_bool_compare_and_swap(&log->durable, seen, target))
+        ;
+    start = (uintptr_t)log & ~page;
+    return msync((void*)start, (uintptr_t)(log + 1) - start, MS_SYNC);
+}
+
 static inline int is_log_empty(dare_log_t* log)
 {
     return (log->end == log->len);
 }
 
+/* whether the smallest entry (a header plus the end byte) fits at offset;
+ * if not, the next entry starts at the beginning of the buffer */
 static inline int log_fit_entry_header(dare_log_t* log, uint64_t offset)
 {
-    return (log->len - offset >= sizeof(dare_log_entry_t));
+    return (log->len - offset >= sizeof(dare_log_entry_t) + 1);
 }
 
 static inline dare_log_entry_t* log_add_new_entry(dare_log_t* log)
@@ -40,6 +40,13 @@ struct dare_server_input_t {
     struct sockaddr_in *my_address;
     int hb_on;
     double hb_period;
+    int hb_core;
+    int log_numa_node;
+    uint32_t shard_count;
+    double lease_ratio;
+    uint64_t log_size;
+    const char* log_file;   // back the log with this file; NULL keeps it in memory
+    uint32_t log_sync_us;
 };
 typedef struct dare_server_input_t dare_server_input_t;
 
@@ -52,6 +59,8 @@ struct dare_server_data_t {
     server_config_t config; // configuration 
     
     dare_log_t  *log;       // local log (remotely accessible)
+    uint32_t shard_count;   // consensus instances sharing the log region
+    int log_mapped;         // the log is a mapping of the log file
     struct ev_loop *loop;
 };
 typedef struct dare_server_data_t dare_server_data_t;
@@ -63,5 +72,6 @@ int server_update_sid( uint64_t new_sid, uint64_t old_sid );
 int dare_rdma_shutdown();
 
 int is_leader();
+int dare_lease_valid();
 
 #endif /* DARE_SERVER_H */
@@ -1,11 +1,16 @@
 #ifndef NODE_H
 #define NODE_H
 #include "../util/common-header.h"
+#include "../util/placement.h"
 #include "../consensus/consensus.h"
 #include "../db/db-interface.h"
 #include "./replica.h"
 
-typedef void (*user_cb)(db_key_type index,void* arg);
+// share of the HB timeout kept back from the read lease for clock drift; a
+// voter also waits lease_ratio + LEASE_DRIFT_MARGIN of it after an HB
+#define LEASE_DRIFT_MARGIN 0.1
+
+typedef void (*user_cb)(db_key_type index,void* record,void* arg);
 typedef void (*up_check)(void* arg);
 typedef int (*up_get)(view_stamp clt_id,void* arg);
 
@@ -14,11 +19,15 @@ typedef struct node_t{
 	int stat_log;
 	int sys_log;
 	view cur_view;
-	view_stamp highest_to_commit;
-	view_stamp highest_committed;
-	view_stamp highest_seen;
-	//consensus component
-	struct consensus_component_t* consensus_comp;
+	view_stamp highest_to_commit[MAX_SHARD_COUNT];
+	view_stamp highest_committed[MAX_SHARD_COUNT];
+	view_stamp highest_seen[MAX_SHARD_COUNT];
+	//consensus components, one per shard
+	uint32_t shard_count;
+	uint64_t log_size;
+	char* log_file;
+	uint32_t log_sync_us;
+	struct consensus_component_t* consensus_comp[MAX_SHARD_COUNT];
 	// replica group
 	struct sockaddr_in my_address;
 	uint32_t group_size;
@@ -31,8 +40,16 @@ typedef struct node_t{
 
 	int hb_on;
 	double hb_period;
+	double lease_ratio;	// below 1 - LEASE_DRIFT_MARGIN
+	int commit_durable;
+
+	batch_config batch;
+	wait_config wait;
+	placement_config placement;
 	
-	pthread_t rep_thread;
+	pthread_t rep_thread[MAX_SHARD_COUNT];
+	pthread_t comp_thread[MAX_SHARD_COUNT];
+	pthread_t persist_thread[MAX_SHARD_COUNT];
 }node;
 
 #endif
@@ -3,24 +3,38 @@
 
 #include "../db/db-interface.h"
 #include "../rdma/dare_log.h"
+#include "../consensus/consensus.h"
 
 typedef struct request_record_t{
-    size_t data_size;
+    uint32_t data_size;
     uint8_t type;
     view_stamp clt_id;
     char data[0];
 }request_record;
 #define REQ_RECORD_SIZE(M) (sizeof(request_record)+(M->data_size))
+// sub-records of a P_BATCH record are packed back to back, each padded to 8 bytes;
+// like stored records, data_size counts the trailing DUMMY_END byte, which is not packed
+#define BATCH_SUB_RECORD_SIZE(M) ((offsetof(request_record, data)+(M)->data_size-1+7)&~((size_t)7))
 typedef uint64_t db_key_type;
 
 struct node_t;
 
-struct node_t* system_initialize(uint32_t* node_id,const char* config_path,const char* log_path,void(*user_cb)(db_key_type index,void* arg),void(*up_check)(void* arg),int(*up_get)(view_stamp clt_id, void* arg),void* db_ptr,void* arg,const char* start_mode);
+struct node_t* system_initialize(uint32_t* node_id,const char* config_path,const char* log_path,void(*user_cb)(db_key_type index,void* record,void* arg),void(*up_check)(void* arg),int(*up_get)(view_stamp clt_id, void* arg),void* db_ptr,void* arg,const char* start_mode);
 
-dare_log_entry_t* rsm_op(struct node_t* my_node, size_t ret, void *buf, uint8_t type, view_stamp* clt_id);
+// shard picks the consensus instance; all requests of one connection must use the same shard
+dare_log_entry_t* rsm_op(struct node_t* my_node, uint32_t shard, size_t ret, void *buf, uint8_t type, view_stamp* clt_id);
+int rsm_op_async(struct node_t* my_node, uint32_t shard, size_t ret, void *buf, uint8_t type, view_stamp* clt_id, rsm_ticket* ticket);
+int rsm_completion_fd(struct node_t* my_node, uint32_t shard);
+// node_id's ack of a P_OUTPUT entry returned by rsm_op; non-zero if it has not arrived
+int rsm_output_ack(struct node_t* my_node, dare_log_entry_t* entry, uint32_t node_id, accept_ack* ack);
 
 uint32_t get_leader_id(struct node_t* my_node);
 uint32_t get_group_size(struct node_t* my_node);
+// entries proposed in the current view, over all shards
+uint64_t rsm_proposals(struct node_t* my_node);
+uint32_t get_shard_count(struct node_t* my_node);
+// whether this node leads and may still answer read-only requests without replicating them
+int leader_lease_valid(struct node_t* my_node);
 
 int launch_rdma(struct node_t* my_node);
 int launch_replica_thread(struct node_t*my_node, list* excluded_threads);
@@ -0,0 +1,52 @@
+#ifndef FD_TABLE_H
+#define FD_TABLE_H
+#include "./common-header.h"
+
+// since max tcp port number will not exceed this number
+#define MAX_FD_SIZE 65536
+// fds of a chunk; a chunk is allocated once one of its fds is registered
+#define FD_CHUNK_BITS 8
+#define FD_CHUNK_SIZE (1 << FD_CHUNK_BITS)
+
+typedef enum fd_type_t{
+	FD_UNKNOWN = 0, // not looked at yet, or closed
+	FD_SOCKET = 1,
+	FD_OTHER = 2,   // looked at once, not a socket
+}fd_type;
+
+typedef enum fd_role_t{
+	FD_ROLE_NONE = 0,
+	FD_ROLE_CLIENT = 1, // leader: a client connection, proposed with P_TCP_CONNECT
+	FD_ROLE_REPLAY = 2, // follower: the server's end of a replayed client connection
+}fd_role;
+
+struct classify_state_t;
+struct output_handler_t;
+
+// What the hooks know about an fd, so that a read or write on it takes no
+// syscall or hash lookup.
+typedef struct fd_state_t{
+	volatile uint8_t type;
+	uint8_t role;
+	view_stamp vs;                      // FD_ROLE_CLIENT: the connection's view stamp
+	struct classify_state_t* cls;       // FD_ROLE_CLIENT with a classifier
+	struct output_handler_t* output;    // allocated on the first output
+}fd_state;
+
+// NULL if nothing about the fd was recorded
+fd_state* fd_state_get(int fd);
+// the state of the fd, allocating its chunk if needed; NULL if fd is too large
+// or the chunk cannot be allocated
+fd_state* fd_state_touch(int fd);
+// records that the fd is a socket
+fd_state* fd_socket_open(int fd);
+// fstats the fd and records whether it is a socket; NULL if fd is too large
+fd_state* fd_state_classify(int fd);
+// like fd_state_get, but an fd nobody recorded (made by an unhooked call, or
+// before the hooks were set up) is classified once and cached
+fd_state* fd_state_known(int fd);
+
+// calls func on every fd with a recorded state
+void fd_state_foreach(void (*func)(int fd, fd_state* st, void* arg), void* arg);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+#include "./common-header.h"
+
+#define PLACE_ANY -1      // leave a thread unpinned
+#define PLACE_NIC_NODE -1 // allocate on the NUMA node of the RDMA NIC
+#define PLACE_NO_NODE -2  // allocate wherever the first touch happens
+
+typedef struct placement_config_t{
+	int replica_core;
+	int completion_core;
+	int persistence_core;
+	int hb_core;
+	int checkpoint_core;
+	int log_numa_node;
+}placement_config;
+
+int pin_thread(pthread_t thread, int core_id);
+int nic_numa_node();
+
+void* numa_alloc(size_t size, int numa_node);
+void* numa_map_file(const char* path, size_t size, int numa_node, int* existed);
+void numa_free(void* addr, size_t size);
+
+void thread_placement_display(FILE* output, const char* name, pthread_t thread);
+void memory_placement_display(FILE* output, const char* name, void* addr);
+
+#endif
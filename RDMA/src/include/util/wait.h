@@ -0,0 +1,51 @@
+#ifndef WAIT_H
+#define WAIT_H
+#include "./common-header.h"
+
+typedef enum wait_mode_t{
+	WAIT_SPIN = 0,  // busy poll
+	WAIT_PAUSE = 1, // busy poll with a pause between rounds
+	WAIT_PARK = 2,  // pause for spin_limit rounds, then sleep on a doorbell
+}wait_mode;
+
+typedef struct wait_config_t{
+	wait_mode mode;
+	uint32_t spin_limit; // idle rounds before parking
+	uint32_t park_us;    // longest sleep without a wakeup
+}wait_config;
+
+typedef struct wait_stat_t{
+	uint64_t spin_ns;
+	uint64_t park_ns;
+	uint64_t parks;
+}wait_stat;
+
+typedef struct doorbell_t{
+	volatile int seq;
+	volatile int sleepers;
+}doorbell;
+
+typedef struct waiter_t{
+	const wait_config* cfg;
+	doorbell* bell;
+	wait_stat* stat;
+	uint32_t rounds;
+	int seq;
+	uint64_t idle_since;
+	uint64_t parked_ns;
+}waiter;
+
+int wait_mode_parse(const char* name, wait_mode* mode);
+
+void waiter_init(waiter* w, const wait_config* cfg, doorbell* bell, wait_stat* stat);
+// call when a poll found nothing to do
+void waiter_idle(waiter* w);
+// call when a poll made progress
+void waiter_busy(waiter* w);
+
+void doorbell_init(doorbell* bell);
+void doorbell_ring(doorbell* bell);
+
+void wait_stat_display(FILE* output, const char* name, wait_stat* stat);
+
+#endif
@@ -4,6 +4,7 @@ Description: The function do_decision will consider the hashvalues from all node
 
 #include "../include/output/output.h"
 #include "../include/util/debug.h"
+#include "../include/rdma/dare.h"
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <stdio.h>
@@ -12,12 +13,28 @@ Description: The function do_decision will consider the hashvalues from all node
 
 #define GUARD_SOCK "/tmp/guard.sock"
 #define MAX_CMD_SIZE 512
+// restore commands waiting for the guard client thread
+#define GUARD_QUEUE_SIZE 64
+
+typedef struct guard_cmd_t{
+	uint32_t node_ids[MAX_SERVER_COUNT];
+	int node_cnt;
+	long hash_index;
+}guard_cmd_t;
+
+static guard_cmd_t guard_queue[GUARD_QUEUE_SIZE];
+static uint64_t guard_head = 0; // commands queued
+static uint64_t guard_tail = 0; // commands taken by the guard client
+static int guard_on = 0;
+static pthread_mutex_t guard_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t guard_cond = PTHREAD_COND_INITIALIZER;
+
 //This function will count the number of nodes whose hashvalue is the same as aim_hash
 int count_hash(output_peer_t* output_peers, int group_size, uint64_t aim_hash){
 	int i=0;
 	int cnt=0;
 	for ( i=0;i<group_size;i++){
-		if (output_peers[i].hash == aim_hash){
+		if (output_peers[i].has_hash && output_peers[i].hash == aim_hash){
 			cnt++;
 		}
 	}	
@@ -25,25 +42,46 @@ int count_hash(output_peer_t* output_peers, int group_size, uint64_t aim_hash){
 }
 
 /*
-This function will return the maximum number of a sub-set whose hash value are the same.
-For example, if the group is (1,1,1,2,2), the function will return 3. And
-(1,2,3,4,5) => 1
-(1,1,2,2,3) => 2 
+This function will return the number of nodes sharing the majority hash, a
+hash held by more than half of the group, and put that hash in *hash_ptr.
+Missing hashes never count. Without a majority, the count it returns is
+at most half of the group. It takes two passes (Boyer-Moore majority vote):
+(1,1,1,2,2) => 3, hash 1
+(1,1,2,2,3) => at most 2
 */
 int major_count_hash(output_peer_t* output_peers, int group_size, uint64_t* hash_ptr){
 	int i=0;
-	int ret=0;
-	int max_cnt=0;
+	int votes=0;
+	int candidate=0;
 	uint64_t aim_hash=0;
 	for ( i=0;i<group_size;i++){
-		aim_hash = output_peers[i].hash;
-		ret = count_hash(output_peers, group_size, aim_hash);	
-		if (ret>max_cnt){
-			max_cnt = ret;
-			*hash_ptr = aim_hash;
+		if (!output_peers[i].has_hash){
+			continue;
 		}
+		candidate=1;
+		if (0 == votes){
+			aim_hash = output_peers[i].hash;
+			votes = 1;
+		}else if (output_peers[i].hash == aim_hash){
+			votes++;
+		}else{
+			votes--;
+		}
+	}
+	*hash_ptr = aim_hash;
+	if (!candidate){
+		return 0;
 	}
-	return max_cnt;
+	return count_hash(output_peers, group_size, aim_hash);
+}
+
+static int master_has_hash(output_peer_t* output_peers, int group_size){
+	for (int i=0; i<group_size; i++){
+		if (output_peers[i].leader_id == output_peers[i].node_id){
+			return output_peers[i].has_hash;
+		}
+	}
+	return 0;
 }
 
 uint64_t get_master_hash(output_peer_t* output_peers, int group_size){
@@ -58,81 +96,180 @@ uint64_t get_master_hash(output_peer_t* output_peers, int group_size){
 	return master_hash;
 }
 
-void* call_send_restore_cmd_start(void* argv){
-	output_peer_t *para = (output_peer_t*)argv;
-	char cmd[MAX_CMD_SIZE];
-	do{
-		if (NULL == para){
-			debug_log("[call_send_restore_cmd_start] parameters are invalid.\n");
-			break;
-		}
-		//GUARD_SOCK
-		// check file existed.
-		if (0!=access(GUARD_SOCK,F_OK)){
-			debug_log("[call_send_restore_cmd_start] sock %s is not existed. Check guard.py.\n",GUARD_SOCK);
-			break;		
-		}
-		int fd,rc;
-		if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-	    		debug_log("[call_send_restore_cmd_start] unix socket create error.\n");
-	    		break;
-		}
-		struct sockaddr_un addr;
-		memset(&addr, 0, sizeof(addr));
-		addr.sun_family = AF_UNIX;
-		strcpy(addr.sun_path, GUARD_SOCK);
-		// It maybe blocked.
-		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
-			debug_log("[call_send_restore_cmd_start] unix socket create error.\n");
-			break;
-		}
-		sprintf(cmd,"restore %u %ld\n",(unsigned int)para->node_id,para->hash_index);
-		rc = write(fd,cmd,strlen(cmd));
-		if (-1 == rc){ // write error
-			debug_log("[call_send_restore_cmd_start] write error: %d, cmd:%s\n",errno,cmd);
-			break;
-		}
-	}while(0);
-	// release parameter;
-	free(argv);
+// connect to guard.py; -1 if it is not there
+static int guard_connect(){
+	//GUARD_SOCK
+	// check file existed.
+	if (0!=access(GUARD_SOCK,F_OK)){
+		debug_log("[guard_connect] sock %s is not existed. Check guard.py.\n",GUARD_SOCK);
+		return -1;
+	}
+	int fd;
+	if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		debug_log("[guard_connect] unix socket create error.\n");
+		return -1;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, GUARD_SOCK);
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+		debug_log("[guard_connect] unix socket connect error: %d\n",errno);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// one line per command: restore node_id[,node_id...] round_id
+static int format_guard_cmd(char* cmd, size_t size, guard_cmd_t* guard_cmd){
+	int len = snprintf(cmd,size,"restore ");
+	for (int i=0;i<guard_cmd->node_cnt;i++){
+		len += snprintf(cmd+len,size-len,i?",%u":"%u",(unsigned int)guard_cmd->node_ids[i]);
+	}
+	len += snprintf(cmd+len,size-len," %ld\n",guard_cmd->hash_index);
+	return len;
+}
+
+static int write_all(int fd, const char* buf, size_t size){
+	while (size > 0){
+		// a guard.py that went away must not kill the replica with SIGPIPE
+		ssize_t rc = send(fd,buf,size,MSG_NOSIGNAL);
+		if (-1 == rc){
+			if (EINTR == errno){
+				continue;
+			}
+			return -1;
+		}
+		buf += rc;
+		size -= rc;
+	}
+	return 0;
+}
+
+// read whatever replies guard.py sent; -1 once it closed the connection
+static int drain_replies(int fd, char* reply, size_t size){
+	for (;;){
+		ssize_t rc = recv(fd,reply,size,MSG_DONTWAIT);
+		if (rc > 0){
+			continue;
+		}
+		if (0 == rc){
+			debug_log("[guard_client] guard.py closed the connection.\n");
+			return -1;
+		}
+		if (EINTR == errno){
+			continue;
+		}
+		if (EAGAIN == errno || EWOULDBLOCK == errno){
+			return 0;
+		}
+		debug_log("[guard_client] read error: %d\n",errno);
+		return -1;
+	}
+}
+
+// The guard client sends the queued commands to guard.py, all of them in one
+// write, over a connection it keeps; it reconnects once if the write fails
+// (EPIPE included) or guard.py closed the connection.
+static void* guard_client(void* argv){
+	char cmd[MAX_CMD_SIZE * GUARD_QUEUE_SIZE];
+	char reply[MAX_CMD_SIZE];
+	int fd = -1;
+	for (;;){
+		int len = 0;
+		pthread_mutex_lock(&guard_lock);
+		while (guard_tail == guard_head){
+			pthread_cond_wait(&guard_cond,&guard_lock);
+		}
+		while (guard_tail < guard_head){
+			len += format_guard_cmd(cmd+len,MAX_CMD_SIZE,&guard_queue[guard_tail % GUARD_QUEUE_SIZE]);
+			guard_tail++;
+		}
+		pthread_mutex_unlock(&guard_lock);
+		debug_log("[guard_client] cmd:%s",cmd);
+		// a connection guard.py closed meanwhile is replaced before the write
+		if (-1 != fd && 0 != drain_replies(fd,reply,sizeof(reply))){
+			close(fd);
+			fd = -1;
+		}
+		for (int attempt=0;attempt<2;attempt++){
+			if (-1 == fd && -1 == (fd = guard_connect())){
+				break;
+			}
+			if (0 == write_all(fd,cmd,len)){
+				break;
+			}
+			debug_log("[guard_client] write error: %d, cmd:%s\n",errno,cmd);
+			close(fd);
+			fd = -1;
+		}
+		// the replies only say whether guard.py served or routed the commands
+		if (-1 != fd && 0 != drain_replies(fd,reply,sizeof(reply))){
+			close(fd);
+			fd = -1;
+		}
+	}
 	return NULL;
 }
-// will send restore cmd to the guard.py
-int send_restore_cmd(uint32_t node_id,long hash_index){
-	debug_log("[send_restore_cmd] id:%u, hash_index:%ld\n",node_id, hash_index);
-	// It is better to start a thread to send the cmd, so that this thread will not be blocked.
-	output_peer_t *para = (output_peer_t*)malloc(sizeof(output_peer_t));
-	para->node_id = node_id;
-	para->hash_index = hash_index;
-	pthread_t thread_id;
-	int ret=pthread_create(&thread_id,NULL,&call_send_restore_cmd_start,(void*)para);
-	if (ret){ // On success, pthread_create() returns 0
-    	debug_log("[send_restore_cmd] call call_send_restore_cmd_start() in a new thread failed. err:%d\n", ret);	
-    	return -1;
-    }
-	return 0;    
+
+int start_guard_client(pthread_t* thread){
+	if (pthread_create(thread,NULL,&guard_client,NULL) != 0){
+		return -1;
+	}
+	guard_on = 1;
+	return 0;
+}
+
+// will queue one restore cmd for all of node_ids to the guard.py
+int send_restore_cmd(uint32_t* node_ids, int node_cnt, long hash_index){
+	debug_log("[send_restore_cmd] %d nodes, hash_index:%ld\n",node_cnt, hash_index);
+	int ret = 0;
+	pthread_mutex_lock(&guard_lock);
+	if (!guard_on){
+		debug_log("[send_restore_cmd] the guard client is not started.\n");
+		ret = -1;
+	}else if (guard_head - guard_tail == GUARD_QUEUE_SIZE){
+		debug_log("[send_restore_cmd] the guard queue is full, the cmd is dropped.\n");
+		ret = -1;
+	}else{
+		guard_cmd_t* guard_cmd = &guard_queue[guard_head % GUARD_QUEUE_SIZE];
+		memcpy(guard_cmd->node_ids,node_ids,node_cnt * sizeof(uint32_t));
+		guard_cmd->node_cnt = node_cnt;
+		guard_cmd->hash_index = hash_index;
+		guard_head++;
+		pthread_cond_signal(&guard_cond);
+	}
+	pthread_mutex_unlock(&guard_lock);
+	return ret;
 }
 
 //This function will send restore cmd to guard.py
 // Any node's hash is different with aim_hash will be restored.
-// If aim_hash is 0 , will nodes will be restored.
-int do_restore(output_peer_t* output_peers, int group_size, uint64_t aim_hash){
+// If aim_hash is NULL , will nodes will be restored.
+// A node whose hash did not arrive is only restored if all nodes are.
+int do_restore(output_peer_t* output_peers, int group_size, const uint64_t* aim_hash){
 	if (NULL == output_peers || 0 == group_size){
 		debug_log("[do_restore] invalid parameters.\n");
 		return -1;
 	}
+	uint32_t node_ids[MAX_SERVER_COUNT];
+	int node_cnt = 0;
 	for (int i=0; i< group_size; i++){
-		debug_log("[do_restore] leader_id:%u, node_id: %u, hashval: 0x%"PRIx64" hash_index:%ld, aim_hash: 0x%"PRIx64"\n",
+		debug_log("[do_restore] leader_id:%u, node_id: %u, hashval: 0x%"PRIx64" hash_index:%ld, all: %d\n",
 			output_peers[i].leader_id,
 			output_peers[i].node_id,
 			output_peers[i].hash,
 			output_peers[i].hash_index,
-			aim_hash);
-		if (0==aim_hash || output_peers[i].hash != aim_hash){
+			NULL==aim_hash);
+		if (NULL==aim_hash || (output_peers[i].has_hash && output_peers[i].hash != *aim_hash)){
 			debug_log("[do_restore] node_id: %u, will be restored.\n",output_peers[i].node_id);
-			send_restore_cmd(output_peers[i].node_id,output_peers[i].hash_index);
+			node_ids[node_cnt++] = output_peers[i].node_id;
 		}		
 	}
+	if (node_cnt){
+		return send_restore_cmd(node_ids,node_cnt,output_peers[0].hash_index);
+	}
 	return 0;
 }
 // do_decision will open a file to log the decision
@@ -160,8 +297,8 @@ int do_decision(output_peer_t* output_peers, int group_size){
 	int major_cnt =0; // number of majority.
 	int ret=0;
 	// It provides a best effor decision.
-	// If one of hash is 0, just return.
-	int zero_count = 0;
+	// Without the leader's hash and a majority of hashes, just return.
+	int missing = 0;
 	for (i = 0; i < group_size; i++){
 		// force hash is different to debug.
 		//if (1==i){
@@ -177,18 +314,17 @@ int do_decision(output_peer_t* output_peers, int group_size){
 			output_peers[i].node_id,
 			output_peers[i].hash,
 			output_peers[i].hash_index);
-		fflush(fp);
-		if (0L == output_peers[i].hash){
-			zero_count++;
+		if (!output_peers[i].has_hash){
+			missing++;
 		}
 	}
-	if (zero_count){
-		fprintf(fp,"[do_decision] failed to make decision since one of hash is 0\n");
-		debug_log("[do_decision] failed to make decision since one of hash is 0\n");
+	threshold = group_size/2 +1;
+	if (!master_has_hash(output_peers,group_size) || group_size - missing < threshold){
+		fprintf(fp,"[do_decision] failed to make decision since %d of hash are missing\n",missing);
+		debug_log("[do_decision] failed to make decision since %d of hash are missing\n",missing);
 		// 0 means do nothing.
-		return 0;
+		goto do_decision_exit;
 	}
-	threshold = group_size/2 +1;
 	/*
 	Design Discuss:
 	1. In this function, I need know who is the leader. Because Decision 3,4 need know whether the hash of leader is same as others.
@@ -196,18 +332,19 @@ int do_decision(output_peer_t* output_peers, int group_size){
 	3. [Solved] by calling get_master_hash()
 	*/
 	con_num = count_hash(output_peers,group_size,master_hash);
-	if (con_num == group_size){ // D.0 all hash are the same.
+	if (con_num == group_size - missing){ // D.0 all hash are the same.
 		fprintf(fp,"[do_decision] D.0 All hash are the same (Nothing to do)\n");
 		debug_log("[do_decision] D.0 All hash are the same (Nothing to do)\n");
 		ret=0;
-		return ret;
+		check_policy_update(0);
+		goto do_decision_exit;
 	}
 	if (con_num >= threshold ){ // // D.1 H(header) == H(major).
 		fprintf(fp,"[do_decision] D.1 Minority need redo.\n");
 		debug_log("[do_decision] D.1 Minority need redo.\n");
 		ret=1;
-		do_restore(output_peers,group_size,master_hash);
-		return ret;	
+		do_restore(output_peers,group_size,&master_hash);
+		goto do_decision_exit;
 	}
 	uint64_t major_hash=0;
 	major_cnt = major_count_hash(output_peers, group_size, &major_hash); 
@@ -215,14 +352,18 @@ int do_decision(output_peer_t* output_peers, int group_size){
     	fprintf(fp,"[do_decision] D.2 Master and Minority need redo. and major_hash is 0x%"PRIx64"\n",major_hash);
     	debug_log("[do_decision] D.2 Master and Minority need redo. and major_hash is 0x%"PRIx64"\n",major_hash);
 		ret=2;
-		do_restore(output_peers,group_size,major_hash);
-		return ret;
+		do_restore(output_peers,group_size,&major_hash);
+		goto do_decision_exit;
     }
 	// consensus failed
 	fprintf(fp,"[hash_consensus] D.3 All nodes need redo.\n");
 	debug_log("[hash_consensus] D.3 All nodes need redo.\n");
 	ret = 3;
-	do_restore(output_peers,group_size,0);
+	do_restore(output_peers,group_size,NULL);
+do_decision_exit:
+	if (ret > 0){
+		check_policy_update(1);
+	}
 	fflush(fp);
 	return ret;
 }
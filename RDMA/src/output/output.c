@@ -5,74 +5,222 @@
 #include "../include/output/crc64.h"
 #include "../include/output/adlist.h"
 #include "../include/util/debug.h"
-void init_output_mgr(){
-	output_manager_t *output_mgr = get_output_mgr();
-	debug_log("[init_output_mgr] output_mgr is inited at %p\n",output_mgr);
-}
+#include <sched.h>
 
-void deinit_output_mgr(){
-	output_manager_t *output_mgr = get_output_mgr();
-	if (output_mgr){ 
-		debug_log("[deinit_output_mgr] output_mgr(%p) will be freed\n",output_mgr);
-		//[TODO] free output_handler first
-		int num = deinit_fd_handler(output_mgr);
-		debug_log("[deinit_output_mgr] %d fd_handler have been freed\n",num);
-		free(output_mgr);
-		output_mgr=NULL;
+static long output_window = OUTPUT_WINDOW;
+
+// free handlers, linked by next_active; each has a ring of handler_window hashes
+static output_handler_t* handler_pool = NULL;
+static long handler_window = 0;
+static pthread_mutex_t handler_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the hasher thread; connections it serves are pushed onto hasher_incoming
+static volatile int hasher_on = 0;
+static output_handler_t* volatile hasher_incoming = NULL;
+static doorbell hasher_bell;
+static wait_stat hasher_wait;
+static wait_config hasher_wait_cfg;
+// stream buffers of closed connections, for reuse
+static unsigned char* stream_pool = NULL;
+static pthread_mutex_t stream_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the check state is shared by every connection's writer thread and the
+// decisions on the completion thread, so it only changes atomically
+static check_policy policy = {CHECK_PERIOD, CHECK_PERIOD * 64, 8, 0.05};
+static volatile long check_period = CHECK_PERIOD;
+static volatile long agree_streak = 0;
+static check_stat check_counters;
+// proposals and checks when the max_share accounting started; a new view
+// numbers its proposals from 0 again, which restarts it under share_lock
+static volatile uint64_t share_proposals = 0;
+static volatile uint64_t share_checks = 0;
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int set_check_policy(const check_policy* p){
+	if (p->min_period <= 0 || p->max_period < p->min_period || p->backoff_after <= 0
+		|| p->max_share <= 0 || p->max_share > 1){
+		return -1;
 	}
+	policy = *p;
+	__sync_lock_test_and_set(&check_period, p->min_period);
+	__sync_lock_test_and_set(&agree_streak, 0);
+	return 0;
+}
+
+void get_check_policy(check_policy* p){
+	*p = policy;
 }
 
-void init_fd_handler(output_manager_t *output_mgr){
-	if (NULL==output_mgr){
+void check_policy_update(int diverged){
+	if (diverged){
+		__sync_fetch_and_add(&check_counters.diverged, 1);
+		// check closely until the replicas agree for a while again
+		__sync_lock_test_and_set(&agree_streak, 0);
+		__sync_lock_test_and_set(&check_period, policy.min_period);
 		return;
 	}
-	memset(output_mgr->fd_handler,0,sizeof(output_mgr->fd_handler));
+	__sync_fetch_and_add(&check_counters.agreed, 1);
+	long streak = __sync_add_and_fetch(&agree_streak, 1);
+	// only the decision that takes the streak back to 0 doubles the period
+	if (streak >= policy.backoff_after && __sync_bool_compare_and_swap(&agree_streak, streak, 0)){
+		long period, next;
+		do {
+			period = check_period;
+			next = period * 2 < policy.max_period ? period * 2 : policy.max_period;
+		} while (!__sync_bool_compare_and_swap(&check_period, period, next));
+	}
+}
+
+void check_stat_get(check_stat* s){
+	*s = check_counters;
+	s->period = check_period;
 }
 
-// return how many fd handler has been freed.
-int deinit_fd_handler(output_manager_t *output_mgr){
-	if (NULL==output_mgr){
-		return 0;
+void check_stat_display(FILE* output){
+	check_stat s;
+	check_stat_get(&s);
+	safe_rec_log(output, "output check: %"PRIu64" checks, %"PRIu64" capped, %"PRIu64" agreed, %"PRIu64" diverged, period %ld\n",
+		s.checks, s.capped, s.agreed, s.diverged, s.period);
+}
+
+// counts one more check if that keeps the checks within max_share of the
+// proposals; two writers can not both take the last one
+static int check_reserve(uint64_t proposals){
+	uint64_t checks;
+	if (policy.max_share >= 1){
+		__sync_fetch_and_add(&check_counters.checks, 1);
+		return 1;
 	}
-	int cnt=0;
-	for (int i=0;i<MAX_FD_SIZE;i++){
-		output_handler_t* ptr = output_mgr->fd_handler[i];
-		if (ptr){
-			delete_output_handler(ptr);
-			ptr=NULL;
-			output_mgr->fd_handler[i] = NULL;
-			cnt++;
+	if (proposals < share_proposals){
+		pthread_mutex_lock(&share_lock);
+		if (proposals < share_proposals){
+			share_checks = check_counters.checks;
+			share_proposals = proposals;
 		}
+		pthread_mutex_unlock(&share_lock);
+	}
+	do {
+		checks = check_counters.checks;
+		if (checks - share_checks + 1 > policy.max_share * (proposals - share_proposals + 1)){
+			return 0;
+		}
+	} while (!__sync_bool_compare_and_swap(&check_counters.checks, checks, checks + 1));
+	return 1;
+}
+
+void set_output_window(long window){
+	if (window > CHECK_GOBACK){
+		output_window = window;
 	}
-	return cnt;
 }
 
-output_manager_t * get_output_mgr(){
-	static output_manager_t * inner_output_mgr=NULL; // This is a singleton of output_mgr
-	if (NULL == inner_output_mgr){
-		//init output manager
-		inner_output_mgr = (output_manager_t *)malloc(sizeof(output_manager_t)); // it will be freed in deinit_output_mgr
-		init_fd_handler(inner_output_mgr);
+void init_output_mgr(){
+	debug_log("[init_output_mgr] output handlers come from slabs of %d\n",OUTPUT_SLAB_SIZE);
+}
+
+static void deinit_fd_output(int fd, fd_state* st, void* arg){
+	if (st->output){
+		delete_output_handler(st->output);
+		st->output = NULL;
+		(*(int*)arg)++;
 	}
-	return inner_output_mgr;
+}
+
+void deinit_output_mgr(){
+	int num = 0;
+	fd_state_foreach(deinit_fd_output, &num);
+	debug_log("[deinit_output_mgr] %d fd_handler have been freed\n",num);
+}
+
+// a handler with its hash ring right behind it, from the pool
+static output_handler_t* alloc_output_handler(){
+	pthread_mutex_lock(&handler_pool_lock);
+	if (NULL == handler_pool){
+		if (0 == handler_window){
+			handler_window = output_window;
+		}
+		size_t size = sizeof(output_handler_t) + handler_window * sizeof(uint64_t);
+		char* slab = (char*)malloc(size * OUTPUT_SLAB_SIZE);
+		if (NULL == slab){
+			pthread_mutex_unlock(&handler_pool_lock);
+			return NULL;
+		}
+		for (int i=0;i<OUTPUT_SLAB_SIZE;i++){
+			output_handler_t* ptr = (output_handler_t*)(slab + i * size);
+			ptr->next_active = handler_pool;
+			handler_pool = ptr;
+		}
+	}
+	output_handler_t* ptr = handler_pool;
+	handler_pool = ptr->next_active;
+	pthread_mutex_unlock(&handler_pool_lock);
+	ptr->window = handler_window;
+	ptr->hash_ring = (uint64_t*)(ptr + 1);
+	return ptr;
 }
 
 static int min(int a, int b){
 	return a<b?a:b;
 }
 
+static output_stream_t* new_output_stream(){
+	output_stream_t* stream = (output_stream_t*)malloc(sizeof(output_stream_t));
+	if (NULL == stream){
+		return NULL;
+	}
+	pthread_mutex_lock(&stream_pool_lock);
+	stream->data = stream_pool;
+	if (NULL != stream_pool){
+		stream_pool = *(unsigned char**)stream_pool;
+	}
+	pthread_mutex_unlock(&stream_pool_lock);
+	if (NULL == stream->data){
+		stream->data = (unsigned char*)malloc(OUTPUT_STREAM_SIZE);
+		if (NULL == stream->data){
+			free(stream);
+			return NULL;
+		}
+	}
+	stream->head = 0;
+	stream->tail = 0;
+	return stream;
+}
+
+static void delete_output_stream(output_stream_t* stream){
+	pthread_mutex_lock(&stream_pool_lock);
+	*(unsigned char**)stream->data = stream_pool;
+	stream_pool = stream->data;
+	pthread_mutex_unlock(&stream_pool_lock);
+	free(stream);
+}
+
 // malloc a output_handler_t for this fd
 output_handler_t* new_output_handler(int fd){
-	output_handler_t* ptr = (output_handler_t*)malloc(sizeof(output_handler_t));
+	output_handler_t* ptr = alloc_output_handler();
+	if (NULL == ptr){
+		return NULL;
+	}
 	ptr->fd = fd;
 	ptr->count = 0;
-	ptr->output_list = listCreate(); 
-	// set free function 
-	ptr->output_list->free = free;
+	memset(ptr->hash_ring, 0, ptr->window * sizeof(uint64_t));
 	ptr->hash = 0L;
-	memset(ptr->hash_buffer,0,sizeof(ptr->hash_buffer));
-	ptr->hash_buffer_curr = 0;
+	ptr->round_crc = 0L;
+	ptr->round_bytes = 0;
 	ptr->called_cnt=0;
+	ptr->checked_cnt=0;
+	ptr->stream = NULL;
+	ptr->reported = 0;
+	ptr->closing = 0;
+	ptr->next_active = NULL;
+	if (hasher_on){
+		ptr->stream = new_output_stream();
+	}
+	// hand it to the hasher thread; without a stream it hashes inline
+	if (NULL != ptr->stream){
+		do {
+			ptr->next_active = hasher_incoming;
+		} while (!__sync_bool_compare_and_swap(&hasher_incoming, ptr->next_active, ptr));
+	}
 	return ptr;
 }
 
@@ -80,36 +228,36 @@ void delete_output_handler(output_handler_t* ptr){
 	if (NULL == ptr){
 		return;
 	}
-	listRelease(ptr->output_list);
-	ptr->output_list = NULL;
-	free(ptr);
+	if (ptr->stream){
+		delete_output_stream(ptr->stream);
+		ptr->stream = NULL;
+	}
+	pthread_mutex_lock(&handler_pool_lock);
+	ptr->next_active = handler_pool;
+	handler_pool = ptr;
+	pthread_mutex_unlock(&handler_pool_lock);
 }
 
 int del_output_handler_by_fd(int fd){
 	debug_log("[del_output_handler_by_fd] fd: %d \n",fd);
 	int retval = -1;
-	output_manager_t *output_mgr = get_output_mgr();
-	if (NULL == output_mgr){
-		return retval;
-	}
-	if (fd>=MAX_FD_SIZE){
-		debug_log("[del_output_handler_by_fd] fd: %d is out of limit %d\n",fd,MAX_FD_SIZE);
-		return retval;
+	fd_state* st = fd_state_get(fd);
+	output_handler_t* ptr = NULL;
+	if (NULL != st){
+		ptr = st->output;
 	}
-	output_handler_t* ptr = output_mgr->fd_handler[fd];
 	if (NULL == ptr){
 		debug_log("[del_output_handler_by_fd] the handler is NULL for fd:%d, no need to delete.\n",fd);
 		retval =0;
 	}else{
-		// release output_list
-		if (ptr->output_list){
-			// The value will be freed during iteratering.
-			listRelease(ptr->output_list);
-			ptr->output_list=NULL;
+		st->output=NULL;
+		if (ptr->stream){
+			// the hasher thread may be hashing its output; it frees the handler
+			ptr->closing = 1;
+		}else{
+			delete_output_handler(ptr);
 		}
-		free(ptr);
 		ptr=NULL;
-		output_mgr->fd_handler[fd]=NULL;
 		retval =0;
 	}
 	return retval;
@@ -117,26 +265,22 @@ int del_output_handler_by_fd(int fd){
 
 output_handler_t* get_output_handler_by_fd(int fd){
 	debug_log("[get_output_handler_by_fd] fd: %d \n",fd);
-	output_manager_t *output_mgr = get_output_mgr();
-	if (NULL == output_mgr){
-		return NULL;
-	}
-	if (fd>=MAX_FD_SIZE){
+	fd_state* st = fd_state_touch(fd);
+	if (NULL == st){
 		debug_log("[get_output_handler_by_fd] fd: %d is out of limit %d\n",fd,MAX_FD_SIZE);
 		return NULL;
 	}
-	output_handler_t* ptr = output_mgr->fd_handler[fd];
-	if (NULL == ptr){ // At the first time, output_handler_t need to be inited.		
-		output_mgr->fd_handler[fd] = new_output_handler(fd);
-		debug_log("[get_output_handler_by_fd] fd: %d got a handler:%p\n",fd,output_mgr->fd_handler[fd]);
+	if (NULL == st->output){ // At the first time, output_handler_t need to be inited.		
+		st->output = new_output_handler(fd);
+		debug_log("[get_output_handler_by_fd] fd: %d got a handler:%p\n",fd,st->output);
 	}
-	return output_mgr->fd_handler[fd];
+	return st->output;
 }
 
 //accept a buff with size, I will store into different connection (fd).
 //And return n number of hash values.
 #ifdef DEBUG_LOG
-void show_buff(unsigned char* buff, ssize_t buff_size){
+void show_buff(const unsigned char* buff, ssize_t buff_size){
 	fprintf(stderr,"[show_buff]#");
 	for (int i=0;i<buff_size;i++){
 		fprintf(stderr,"0x%x,",buff[i]);
@@ -144,11 +288,69 @@ void show_buff(unsigned char* buff, ssize_t buff_size){
 	fprintf(stderr,"#\n");
 }
 #else
-void show_buff(unsigned char* buff, ssize_t buff_size){
+void show_buff(const unsigned char* buff, ssize_t buff_size){
 	return;
 }
 #endif
 
+// Hashes up to size bytes of output, no further than the end of the current
+// round, and publishes the round's hash if that completed it. Returns the
+// bytes taken.
+static int hash_output(output_handler_t* output_handler, const unsigned char* buff, ssize_t size){
+	int actual_size = min(HASH_BUFFER_SIZE - output_handler->round_bytes, size);
+	output_handler->round_crc = crc64(output_handler->round_crc,buff,actual_size);
+	output_handler->round_bytes+=actual_size;
+	if (HASH_BUFFER_SIZE==output_handler->round_bytes){ // The round is complete.
+		output_handler->hash = output_handler->round_crc;
+		output_handler->round_bytes=0;
+		debug_log("[hash_output] fd:%d, hash is generated, hash:0x%"PRIx64"\n",output_handler->fd, output_handler->hash);
+		if (output_handler->hash_ring){
+			// overwrites the hash of round count - window
+			output_handler->hash_ring[output_handler->count % output_handler->window] = output_handler->hash;
+			// readers on other threads go by count
+			__sync_synchronize();
+			output_handler->count++;
+			debug_log("[hash_output] fd:%d, hash is putted into hash_ring. count:%ld, hash:0x%"PRIx64"\n", 
+			output_handler->fd, output_handler->count, output_handler->hash);
+		}else{
+			debug_log("[hash_output] [error] hash_ring is NULL, fd:%d, output_handler ptr:%p\n",output_handler->fd,output_handler);
+		}
+	}
+	return actual_size;
+}
+
+// Queues output for the hasher thread; waits while the stream is full.
+static void push_output(output_handler_t* output_handler, const unsigned char* buff, ssize_t size){
+	output_stream_t* stream = output_handler->stream;
+	while (size > 0){
+		uint64_t room = OUTPUT_STREAM_SIZE - (stream->head - stream->tail);
+		if (0 == room){
+			doorbell_ring(&hasher_bell);
+			sched_yield();
+			continue;
+		}
+		uint64_t offset = stream->head % OUTPUT_STREAM_SIZE;
+		uint64_t n = OUTPUT_STREAM_SIZE - offset;
+		if (n > room){
+			n = room;
+		}
+		if (n > (uint64_t)size){
+			n = size;
+		}
+		memcpy(stream->data + offset, buff, n);
+		// the bytes before the head that covers them
+		__sync_synchronize();
+		stream->head += n;
+		buff += n;
+		size -= n;
+	}
+	doorbell_ring(&hasher_bell);
+}
+
+// The output is hashed straight from buff, in rounds of HASH_BUFFER_SIZE
+// bytes; crc64 streams, so a round split over calls hashes the same as the
+// whole round would. With the hasher thread, the output is only queued, and
+// the rounds it published since the last call are reported instead.
 int store_output(int fd, const unsigned char *buff, ssize_t buff_size)
 {
 	show_buff(buff,buff_size);
@@ -164,47 +366,84 @@ int store_output(int fd, const unsigned char *buff, ssize_t buff_size)
 		debug_log("[store_output] fd:%d, get_output_handler_by_fd error. \n",fd);
 		return retval;
 	}
-	// The following code will put buff into output_handler.hash_buffer
-	// Please do not delete the comment unless you list your reason at here. ^^.Thanks.
-	int push_size =0;
-	retval=0; // default value means no hash value is generated.
+	if (output_handler->stream){
+		push_output(output_handler,buff,buff_size);
+		long published = output_handler->count;
+		retval = published - output_handler->reported;
+		output_handler->reported = published;
+		return retval;
+	}
+	ssize_t push_size =0;
+	long count = output_handler->count;
 	while (push_size < buff_size){ // Which means the input buff has not been handled.
-		int left_space = HASH_BUFFER_SIZE - output_handler->hash_buffer_curr;
-		int wait_size = buff_size - push_size;
-		int actual_size = min(left_space,wait_size); 
-		unsigned char * dest_ptr = output_handler->hash_buffer + output_handler->hash_buffer_curr;
-		// Bugfixed. at memcpy, buff need a offset.
-		unsigned char* src_ptr = buff+push_size;
-		memcpy(dest_ptr,src_ptr,actual_size);
-		output_handler->hash_buffer_curr+=actual_size;
-		left_space = HASH_BUFFER_SIZE - output_handler->hash_buffer_curr;
-		push_size+=actual_size;
-		debug_log("[store_output] fd:%d, copied %d bytes into hash_buffer[%d/%d], then push_size:%d\n",fd,actual_size,output_handler->hash_buffer_curr,HASH_BUFFER_SIZE,push_size);
-		if (0==left_space){ // The hash buffer is full.
-			show_buff(output_handler->hash_buffer,HASH_BUFFER_SIZE);
-			debug_log("[store_output] fd:%d, previous hash:0x%"PRIx64", buff will be used for crc64.\n",fd,output_handler->hash);
-			output_handler->hash = crc64(output_handler->hash,output_handler->hash_buffer,HASH_BUFFER_SIZE);
-			// curr is clear, since new hash is generated.
-			output_handler->hash_buffer_curr=0;
-			debug_log("[store_output] fd:%d, hash is generated, hash:0x%"PRIx64"\n",fd, output_handler->hash);
-			if (output_handler->output_list){
-				// add hash into output_list;
-				uint64_t *new_hash = (uint64_t*)malloc(sizeof(uint64_t));
-				*new_hash = output_handler->hash;
-				listAddNodeTail(output_handler->output_list, (void*)new_hash);
-				debug_log("[store_output] fd:%d, hash is putted into output_list. count:%ld, hash:0x%"PRIx64"\n", 
-				fd, output_handler->count, output_handler->hash);
-				output_handler->count++;
-				retval++;// one hash value is generated.
-			}else{
-				debug_log("[store_output] [error] output_list is NULL, fd:%d, output_handler ptr:%p\n",fd,output_handler);
+		push_size += hash_output(output_handler,buff+push_size,buff_size-push_size);
+	}
+	retval = output_handler->count - count; // how many hash values are generated.
+	return retval;
+}
+
+static void* output_hasher(void* arg){
+	output_handler_t* active = NULL;
+	output_handler_t *ptr, **link;
+	waiter w;
+
+	waiter_init(&w, &hasher_wait_cfg, &hasher_bell, &hasher_wait);
+	for (;;){
+		int progress = 0;
+		// take the new connections
+		if (NULL != hasher_incoming){
+			ptr = __sync_lock_test_and_set(&hasher_incoming, NULL);
+			while (NULL != ptr){
+				output_handler_t* next = ptr->next_active;
+				ptr->next_active = active;
+				active = ptr;
+				ptr = next;
+			}
+		}
+		link = &active;
+		while (NULL != (ptr = *link)){
+			output_stream_t* stream = ptr->stream;
+			int closing = ptr->closing;
+			uint64_t head = stream->head;
+			__sync_synchronize();
+			while (stream->tail < head){
+				uint64_t offset = stream->tail % OUTPUT_STREAM_SIZE;
+				uint64_t n = head - stream->tail;
+				if (n > OUTPUT_STREAM_SIZE - offset){
+					n = OUTPUT_STREAM_SIZE - offset;
+				}
+				n = hash_output(ptr,stream->data + offset,n);
+				__sync_synchronize();
+				stream->tail += n;
+				progress = 1;
+			}
+			if (closing && stream->tail == stream->head){
+				*link = ptr->next_active;
+				delete_output_handler(ptr);
+				continue;
 			}
+			link = &ptr->next_active;
+		}
+		if (progress){
+			waiter_busy(&w);
+		}else{
+			waiter_idle(&w);
 		}
 	}
-	return retval;
+	return NULL;
+}
+
+int start_output_hasher(pthread_t* thread, const wait_config* cfg){
+	hasher_wait_cfg = *cfg;
+	doorbell_init(&hasher_bell);
+	if (pthread_create(thread, NULL, output_hasher, NULL) != 0){
+		return -1;
+	}
+	hasher_on = 1;
+	return 0;
 }
 
-long determine_output(int fd){
+long determine_output(int fd, uint64_t proposals){
 	debug_log("[determine_output] fd: %d\n",fd);
 	long retval=-1;
 	// A output_handler will be got from different fd
@@ -214,57 +453,42 @@ long determine_output(int fd){
 		return retval;
 	}
 	output_handler->called_cnt++;
-	if (output_handler->called_cnt%CHECK_PERIOD == 0){ 
-		// A output conconsistency will be triggred.
-		// However, if one machine is slow, it may not calculate hash value at this round.
-		// We decide to propose hash value in the old round.
-		long round_goback = output_handler->count - CHECK_GOBACK;
-		if (round_goback>=0){
-			retval = round_goback;
-		}else{
-			retval = -1;
-		}
-	}else{
-		retval = -1;
+	if (output_handler->called_cnt - output_handler->checked_cnt < check_period){
+		return retval;
 	}
+	// A output conconsistency will be triggred.
+	// However, if one machine is slow, it may not calculate hash value at this round.
+	// We decide to propose hash value in the old round.
+	long round_goback = output_handler->count - CHECK_GOBACK;
+	if (round_goback < 0){
+		return retval;
+	}
+	if (!check_reserve(proposals)){
+		// put off until the other proposals make room for it
+		__sync_fetch_and_add(&check_counters.capped, 1);
+		return retval;
+	}
+	output_handler->checked_cnt = output_handler->called_cnt;
+	retval = round_goback;
 	return retval;
 }
 
-// if not found, it will return 0
-uint64_t get_val_by_index(list *list_head, long index){
-	listNode *ln;
-    listIter li;
-    long cnt=0;
-    uint64_t retval = 0;
-    listRewind(list_head,&li);
-    while((ln = listNext(&li))) {
-    	uint64_t val = *(uint64_t *)listNodeValue(ln);
-    	if (index == cnt){ // Found it
-    		retval = val;
-    		debug_log("[get_val_by_index] found val:0x%"PRIx64" at index:%ld\n",retval,index);
-    		return retval;
-    	}
-    	cnt++;
-    }
-    debug_log("[get_val_by_index] Not Found at index:%ld, 0 will be returned\n",index);
-    return retval;
-}
-// If it is impossible to get hash value, 0 will be returned as default value.
-uint64_t get_output_hash(int fd, long hash_index){
+// If it is impossible to get hash value, -1 will be returned.
+int get_output_hash(int fd, long hash_index, uint64_t* hash){
 	debug_log("[get_output_hash] fd: %d hash_index:%ld\n",fd,hash_index);
-	uint64_t retval = 0;
+	int retval = -1;
 	// A output_handler will be got from different fd
 	output_handler_t* output_handler = get_output_handler_by_fd(fd);
 	if (NULL == output_handler){// error
 		debug_log("[get_output_hash] fd:%d, get_output_handler_by_fd error. \n",fd);
 		return retval;
 	}
-	if (hash_index < output_handler->count){
-		list * list_head = output_handler->output_list;
-		retval = get_val_by_index(list_head,hash_index);
-	}else{
-		debug_log("[get_output_hash] hash_index: %ld is invalid, count: %ld\n", hash_index, output_handler->count);
+	if (hash_index >= 0 && hash_index < output_handler->count && hash_index >= output_handler->count - output_handler->window){
+		*hash = output_handler->hash_ring[hash_index % output_handler->window];
+		debug_log("[get_output_hash] found val:0x%"PRIx64" at index:%ld\n",*hash,hash_index);
 		retval = 0;
+	}else{
+		debug_log("[get_output_hash] hash_index: %ld is invalid, count: %ld, window: %ld\n", hash_index, output_handler->count, output_handler->window);
 	}
 	return retval;
 }
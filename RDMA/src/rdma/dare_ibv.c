@@ -260,9 +260,9 @@ int find_max_inline(struct ibv_context *context, struct ibv_pd *pd, uint32_t *ma
     return rc;
 }
 
-int dare_ib_send_hb()
+int dare_ib_send_hb(uint32_t *acked, uint64_t wait_ns)
 {
-    return rc_send_hb();
+    return rc_send_hb(acked, wait_ns);
 }
 
 int  dare_ib_send_vote_request()
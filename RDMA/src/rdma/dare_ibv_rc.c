@@ -19,18 +19,31 @@ static int rc_cq_create(dare_ib_ep_t* ep);
 static int rc_qp_init_to_rtr(dare_ib_ep_t *ep, uint16_t dlid, uint8_t *dgid);
 static int rc_qp_rtr_to_rts(dare_ib_ep_t *ep);
 static int rc_qp_reset_to_init( dare_ib_ep_t *ep);
-static int poll_cq(int max_wc, struct ibv_cq *cq);
+static int poll_cq(int max_wc, dare_ib_ep_t *ep);
+static int cq_drain(rc_cq_t *cq);
+static uint64_t rc_now_ns();
+static int post_send_wr(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, enum ibv_wr_opcode opcode, rem_mem_t *rm, int send_flags, int poll_completion, uint64_t wr_id);
 static int rc_qp_reset(dare_ib_ep_t *ep);
 
+/* The HB writes carry their own wr_id, so a completion left over from
+ * another signaled write is not taken for an ack */
+#define HB_WR_TAG 0x4842000000000000ULL
+#define HB_WR_MASK 0xFFFF000000000000ULL
+static uint32_t hb_seq;
+
 /* ================================================================== */
 
-int rc_send_hb()
+/* acked counts the servers whose HB write completed successfully within
+ * wait_ns; a completion that comes later is left for the next round to skip */
+int rc_send_hb(uint32_t *acked, uint64_t wait_ns)
 {
     int rc;
     dare_ib_ep_t *ep;
-    uint8_t i, size;
+    uint8_t i, size, pending = 0;
+    uint64_t wr_ids[MAX_SERVER_COUNT] = {0};
     
     size = SRV_DATA->config.cid.size;
+    *acked = 0;
     
     /* Set offset accordingly */
     uint32_t offset = (uint32_t) (offsetof(dare_log_t, ctrl_data) + offsetof(ctrl_data_t, hb) + sizeof(uint64_t) * (*SRV_DATA->config.idx));
@@ -46,12 +59,41 @@ int rc_send_hb()
         rm.raddr = ep->rc_ep.rmt_mr.raddr + offset;
         rm.rkey = ep->rc_ep.rmt_mr.rkey;
         /* server_id, buf, len, mr, opcode, rm, signaled, poll_completion */ 
-        rc = post_send(i, &SRV_DATA->log->ctrl_data.sid, sizeof(uint64_t), IBDEV->lcl_mr, IBV_WR_RDMA_WRITE, &rm, 1, 0);
+        uint64_t wr_id = HB_WR_TAG | ++hb_seq;
+        rc = post_send_wr(i, &SRV_DATA->log->ctrl_data.sid, sizeof(uint64_t), IBDEV->lcl_mr, IBV_WR_RDMA_WRITE, &rm, 1, 0, wr_id);
         if (0 != rc) {
             /* This should never happen */
             error_return(1, log_fp, "Cannot post send operation\n");
         }
-    poll_cq(1, ep->rc_ep.rc_cq.cq);
+        wr_ids[i] = wr_id;
+        pending++;
+    }
+
+    /* Wait for all of them together, but never past wait_ns */
+    uint64_t deadline = rc_now_ns() + wait_ns;
+    while (pending > 0) {
+        for (i = 0; i < size; i++) {
+            if (0 == wr_ids[i]) continue;
+            rc_cq_t *cq = &((dare_ib_ep_t*)SRV_DATA->config.servers[i].ep)->rc_ep.rc_cq;
+            pthread_mutex_lock(&cq->lock);
+            rc = cq_drain(cq);
+            int done = (cq->hb_done == wr_ids[i]);
+            int status = cq->hb_status;
+            pthread_mutex_unlock(&cq->lock);
+            if (rc < 0) {
+                error_return(1, log_fp, "Cannot poll the HB completion of server %"PRIu8"\n", i);
+            }
+            if (!done) continue;
+            if (IBV_WC_SUCCESS == status) {
+                (*acked)++;
+            } else {
+                fprintf(stderr, "HB to server %"PRIu8" has error status: %d (means: %s)\n", i, -status, ibv_wc_status_str(status));
+            }
+            wr_ids[i] = 0;
+            pending--;
+        }
+        if (pending > 0 && rc_now_ns() >= deadline)
+            break;
     }
 
     return 0;
@@ -86,7 +128,7 @@ int rc_send_vote_request()
             /* This should never happen */
             error_return(1, log_fp, "Cannot post send operation\n");
         }
-    poll_cq(1, ep->rc_ep.rc_cq.cq);
+    poll_cq(1, ep);
     }
 
     return 0;
@@ -116,7 +158,7 @@ int rc_send_vote_ack()
         /* This should never happen */
         error_return(1, log_fp, "Cannot post send operation\n");
     }
-    poll_cq(1, ep->rc_ep.rc_cq.cq);
+    poll_cq(1, ep);
     return 0;
 }
 
@@ -209,6 +251,7 @@ static void rc_cq_destroy(dare_ib_ep_t* ep)
         rdma_error(log_fp, "ibv_destroy_cq failed because %s\n", strerror(rc));
     }
     ep->rc_ep.rc_cq.cq = NULL;
+    pthread_mutex_destroy(&ep->rc_ep.rc_cq.lock);
 }
 
 static int 
@@ -218,6 +261,11 @@ rc_cq_create( dare_ib_ep_t* ep )
     if (NULL == ep->rc_ep.rc_cq.cq) {
         error_return(1, log_fp, "Cannot create CQ\n");
     }
+    pthread_mutex_init(&ep->rc_ep.rc_cq.lock, NULL);
+    ep->rc_ep.rc_cq.hb_done = 0;
+    ep->rc_ep.rc_cq.hb_status = IBV_WC_SUCCESS;
+    ep->rc_ep.rc_cq.others = 0;
+    ep->rc_ep.rc_cq.other_status = IBV_WC_SUCCESS;
 
     return 0;
 }
@@ -273,7 +321,7 @@ static int rc_prerequisite()
 static int rc_memory_reg()
 {  
     /* Register memory for local log */    
-    IBDEV->lcl_mr = ibv_reg_mr(IBDEV->rc_pd, SRV_DATA->log, sizeof(dare_log_t) + SRV_DATA->log->len, IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_LOCAL_WRITE);
+    IBDEV->lcl_mr = ibv_reg_mr(IBDEV->rc_pd, SRV_DATA->log, log_region_size(SRV_DATA->log, SRV_DATA->shard_count), IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_LOCAL_WRITE);
     if (NULL == IBDEV->lcl_mr) {
         error_return(1, log_fp, "Cannot register memory because %s\n", strerror(errno));
     }
@@ -405,6 +453,11 @@ int rc_connect_server(uint8_t idx, uint16_t dlid, uint8_t *dgid)
 }
 
 int post_send(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, enum ibv_wr_opcode opcode, rem_mem_t *rm, int send_flags, int poll_completion)
+{
+    return post_send_wr(server_id, buf, len, mr, opcode, rm, send_flags, poll_completion, 0);
+}
+
+static int post_send_wr(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, enum ibv_wr_opcode opcode, rem_mem_t *rm, int send_flags, int poll_completion, uint64_t wr_id)
 {
     int rc;
 
@@ -422,6 +475,7 @@ int post_send(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, en
     sg.lkey   = mr->lkey;
 
     memset(&wr, 0, sizeof(wr));
+    wr.wr_id      = wr_id;
     wr.sg_list    = &sg;
     wr.num_sge    = 1;
     wr.opcode     = opcode;
@@ -429,7 +483,7 @@ int post_send(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, en
     wr.send_flags = send_flags;
 
     if (poll_completion)
-        poll_cq(1, ep->rc_ep.rc_cq.cq);
+        poll_cq(1, ep);
 
     if (IBV_WR_RDMA_WRITE == opcode) {
         if (len <= IBDEV->rc_max_inline_data) {
@@ -449,27 +503,61 @@ int post_send(uint32_t server_id, void *buf, uint32_t len, struct ibv_mr *mr, en
     return 0;
 }
 
-static int poll_cq(int max_wc, struct ibv_cq *cq)
+static uint64_t rc_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Files every completion the CQ holds, under cq->lock: an HB's for the HB
+ * thread, the others as a count for poll_cq. Returns 0, or the negative
+ * ibv_poll_cq error. */
+static int cq_drain(rc_cq_t *cq)
 {
-    struct ibv_wc wc[1];
-    int ret = -1, i, total_wc = 0;
-    do {
-        ret = ibv_poll_cq(cq, max_wc - total_wc, wc + total_wc);
-        if (ret < 0)
-        {
-            fprintf(stderr, "Failed to poll cq for wc due to %d \n", ret);
+    struct ibv_wc wc;
+    int ret;
+    while ((ret = ibv_poll_cq(cq->cq, 1, &wc)) > 0) {
+        if (HB_WR_TAG == (wc.wr_id & HB_WR_MASK)) {
+            cq->hb_done = wc.wr_id;
+            cq->hb_status = wc.status;
+        } else {
+            cq->others++;
+            if (IBV_WC_SUCCESS == cq->other_status)
+                cq->other_status = wc.status;
+        }
+    }
+    if (ret < 0)
+        fprintf(stderr, "Failed to poll cq for wc due to %d \n", ret);
+    return ret;
+}
+
+/* Waits for max_wc completions of the writes other than the HBs */
+static int poll_cq(int max_wc, dare_ib_ep_t *ep)
+{
+    rc_cq_t *cq = &ep->rc_ep.rc_cq;
+    int ret, status = IBV_WC_SUCCESS;
+    for (;;) {
+        pthread_mutex_lock(&cq->lock);
+        ret = cq_drain(cq);
+        if (ret < 0) {
+            pthread_mutex_unlock(&cq->lock);
             return ret;
         }
-        total_wc += ret;
-    } while(total_wc < max_wc);
-    fprintf(stdout, "%d WC are completed \n", total_wc);
-    for (i = 0; i < total_wc; i++)
-    {
-        if (wc[i].status != IBV_WC_SUCCESS)
-        {
-            fprintf(stderr, "Work completion (WC) has error status: %d (means: %s) at index %d\n", -wc[i].status, ibv_wc_status_str(wc[i].status), i);
-            return -(wc[i].status);
+        if (cq->others >= (uint32_t)max_wc) {
+            cq->others -= max_wc;
+            status = cq->other_status;
+            cq->other_status = IBV_WC_SUCCESS;
+            pthread_mutex_unlock(&cq->lock);
+            break;
         }
+        pthread_mutex_unlock(&cq->lock);
+    }
+    fprintf(stdout, "%d WC are completed \n", max_wc);
+    if (status != IBV_WC_SUCCESS)
+    {
+        fprintf(stderr, "Work completion (WC) has error status: %d (means: %s)\n", -status, ibv_wc_status_str(status));
+        return -status;
     }
-    return total_wc;
+    return max_wc;
 }
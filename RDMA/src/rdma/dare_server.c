@@ -12,11 +12,20 @@ ev_idle poll_event;
 ev_timer hb_event;
 
 double hb_period;
+/* the leader may answer reads locally until lease_expiry (CLOCK_MONOTONIC, ns) */
+double lease_ratio;
+static volatile uint64_t lease_expiry;
+/* a voter refuses vote requests until then: an old leader may hold a lease
+ * from the last HB it saw (CLOCK_MONOTONIC, ns) */
+static uint64_t vote_block_until;
+/* how often the log file is written back */
+uint32_t log_sync_us;
 const uint64_t elec_timeout_low = 100000;
 const uint64_t elec_timeout_high = 300000;
 
 static double random_election_timeout();
 static double hb_timeout();
+static uint64_t lease_now();
 static void start_election();
 static void poll_vote_count();
 
@@ -24,6 +33,7 @@ static void polling();
 static void poll_vote_requests();
 
 static void *hb_begin(void *arg);
+static void *log_sync_begin(void *arg);
 static void hb_receive_cb( EV_P_ ev_timer *w, int revents );
 static void hb_send_cb( EV_P_ ev_timer *w, int revents );
 static void poll_cb( EV_P_ ev_idle *w, int revents );
@@ -57,14 +67,29 @@ int dare_server_init(dare_server_input_t *input)
 
     init_network_cb();
 
+    if (data.log_mapped)
+    {
+        log_sync_us = data.input->log_sync_us;
+
+        pthread_t sync_thread;
+        rc = pthread_create(&sync_thread, NULL, log_sync_begin, NULL);
+        if (rc != 0)
+            fprintf(stderr, "pthread_create log_sync_begin fail\n");
+    }
+
     if (data.input->hb_on == 1)
     {
         hb_period = data.input->hb_period;
+        lease_ratio = data.input->lease_ratio;
 
         pthread_t hb_thread;
         rc = pthread_create(&hb_thread, NULL, hb_begin, NULL);
         if (rc != 0)
             fprintf(stderr, "pthread_create hb_begin fail\n");
+        else {
+            pin_thread(hb_thread, data.input->hb_core);
+            thread_placement_display(stderr, "heartbeat", hb_thread);
+        }
     }
 
     return 0;
@@ -97,17 +122,27 @@ static int init_server_data()
     }
 
     /* Set up log */
-    data.log = log_new();
+    data.shard_count = data.input->shard_count;
+    data.log = log_new(data.input->log_numa_node, data.shard_count, data.input->log_size, data.input->log_file);
     if (NULL == data.log) {
         error_return(1, log_fp, "Cannot allocate log\n");
     }
+    data.log_mapped = (NULL != data.input->log_file);
+    memory_placement_display(stderr, "log", data.log);
+    if (data.log_mapped)
+        fprintf(stderr, "log: backed by %s\n", data.input->log_file);
     
     return 0;
 }
 
 static void free_server_data()
 {   
-    log_free(data.log);
+    uint32_t i;
+    if (data.log_mapped && NULL != data.log) {
+        for (i = 0; i < data.shard_count; i++)
+            log_sync(log_shard(data.log, i), log_sync_target(log_shard(data.log, i)));
+    }
+    log_free(data.log, data.shard_count);
     
     if (NULL != data.config.servers) {
         free(data.config.servers);
@@ -180,6 +215,26 @@ static void *hb_begin(void *arg)
     return NULL;
 }
 
+/* Writes the log file back every log_sync_us; one msync covers all the
+ * entries that arrived in the meantime. */
+static void *log_sync_begin(void *arg)
+{
+    struct timespec interval;
+    uint32_t i;
+
+    interval.tv_sec = log_sync_us / 1000000;
+    interval.tv_nsec = (log_sync_us % 1000000) * 1000;
+    for (;;) {
+        nanosleep(&interval, NULL);
+        for (i = 0; i < data.shard_count; i++) {
+            dare_log_t* shard = log_shard(data.log, i);
+            if (0 != log_sync(shard, log_sync_target(shard)))
+                rdma_error(log_fp, "Cannot write back shard %"PRIu32" of the log\n", i);
+        }
+    }
+    return NULL;
+}
+
 static void hb_receive_cb(EV_P_ ev_timer *w, int revents)
 {
     uint64_t hb;
@@ -208,6 +263,9 @@ static void hb_receive_cb(EV_P_ ev_timer *w, int revents)
         timeout = 0;
         /* Check if it is from a leader */
         if (SID_GET_L(hb)) {
+            /* it arrived no later than now, so its lease ends before this */
+            if (lease_ratio > 0)
+                vote_block_until = lease_now() + (uint64_t)(hb_timeout() * (lease_ratio + LEASE_DRIFT_MARGIN) * 1e9);
 		fprintf(stdout, "Received HB: [%010"PRIu64"|%d|%03"PRIu8"]\n", SID_GET_TERM(hb), (SID_GET_L(hb) ? 1 : 0), SID_GET_IDX(hb));
         }
     }
@@ -249,6 +307,14 @@ static void start_election()
 {
     int rc, i;
     
+    /* My own vote counts too; hold it back while a lease may be held */
+    uint64_t now = lease_now();
+    if (now < vote_block_until) {
+        hb_event.repeat = (double)(vote_block_until - now) * 1e-9;
+        ev_timer_again(data.loop, &hb_event);
+        return;
+    }
+    
     /* Get the latest SID */
     uint64_t new_sid = 0;    
     
@@ -281,15 +347,37 @@ static void start_election()
     }
 }
 
+static uint64_t lease_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* A follower that took an HB sent at time t refuses to vote, itself
+ * included, until (lease_ratio + LEASE_DRIFT_MARGIN) * hb_timeout() after it
+ * arrived. So once a majority has taken it, nobody else can become leader
+ * before the lease of lease_ratio * hb_timeout() from t ends, even with the
+ * clocks running apart by the margin. */
+int dare_lease_valid()
+{
+    return lease_now() < lease_expiry;
+}
+
 static void hb_send_cb( EV_P_ ev_timer *w, int revents )
 {
     int rc;
+    uint32_t acked;
+    uint64_t sent = lease_now();
 
     /* Send HB to all servers */
     //fprintf(stderr, "Sending HB\n");
-    rc = dare_ib_send_hb();
+    /* an HB that has not completed within half a period is not an ack */
+    rc = dare_ib_send_hb(&acked, (uint64_t)(hb_period * 1e9 / 2));
     if (0 != rc) {
         rdma_error(log_fp, "Cannot send heartbeats\n");
+    } else if (lease_ratio > 0 && acked + 1 >= data.config.cid.size / 2 + 1) {
+        lease_expiry = sent + (uint64_t)(hb_timeout() * lease_ratio * 1e9);
     }
     
     /* Rearm timer */
@@ -365,6 +453,10 @@ static void poll_vote_requests()
         fprintf(stdout, "Active leader known; just ignore vote requests\n");
         return;
     }
+    /* The old leader may still answer reads under its lease; the requests
+     * stay where they are until it ran out */
+    if (lease_now() < vote_block_until)
+        return;
 
     /*Note: set the L flag to avoid voting twice in the same term:
           SID=[TERM|L|IDX] => [TERM|1|voted_idx] > [TERM|0|*] */
@@ -16,7 +16,14 @@ int launch_rdma(node* my_node)
         .cur_view = &my_node->cur_view,
         .my_address = &my_node->my_address,
         .hb_on = my_node->hb_on,
-        .hb_period = my_node->hb_period
+        .hb_period = my_node->hb_period,
+        .hb_core = my_node->placement.hb_core,
+        .log_numa_node = my_node->placement.log_numa_node,
+        .shard_count = my_node->shard_count,
+        .lease_ratio = my_node->lease_ratio,
+        .log_size = my_node->log_size,
+        .log_file = my_node->log_file,
+        .log_sync_us = my_node->log_sync_us
     };
 
     if (0 != dare_server_init(&input)) {
@@ -29,15 +36,45 @@ int launch_rdma(node* my_node)
 int launch_replica_thread(node* my_node, list* excluded_threads)
 {
     int rc = 0;
-    if (pthread_create(&my_node->rep_thread,NULL,handle_accept_req,my_node->consensus_comp) != 0)
-        rc = 1;
-    pthread_t *replica_thread = (pthread_t*)malloc(sizeof(pthread_t));
-    *replica_thread = my_node->rep_thread;
-    listAddNodeTail(excluded_threads, (void*)replica_thread);
+    uint32_t shard;
+    char name[32];
+    placement_config* place = &my_node->placement;
+
+    for (shard = 0; shard < my_node->shard_count; shard++) {
+        recover_consensus_comp(my_node->consensus_comp[shard]);
+
+        if (pthread_create(&my_node->rep_thread[shard],NULL,handle_accept_req,my_node->consensus_comp[shard]) != 0)
+            rc = 1;
+        pthread_t *replica_thread = (pthread_t*)malloc(sizeof(pthread_t));
+        *replica_thread = my_node->rep_thread[shard];
+        listAddNodeTail(excluded_threads, (void*)replica_thread);
+
+        if (pthread_create(&my_node->comp_thread[shard],NULL,handle_completion,my_node->consensus_comp[shard]) != 0)
+            rc = 1;
+        pthread_t *completion_thread = (pthread_t*)malloc(sizeof(pthread_t));
+        *completion_thread = my_node->comp_thread[shard];
+        listAddNodeTail(excluded_threads, (void*)completion_thread);
+
+        if (pthread_create(&my_node->persist_thread[shard],NULL,handle_persistence,my_node->consensus_comp[shard]) != 0)
+            rc = 1;
+        pthread_t *persist_thread = (pthread_t*)malloc(sizeof(pthread_t));
+        *persist_thread = my_node->persist_thread[shard];
+        listAddNodeTail(excluded_threads, (void*)persist_thread);
+
+        pin_thread(my_node->rep_thread[shard], (PLACE_ANY == place->replica_core) ? PLACE_ANY : place->replica_core + (int)shard);
+        pin_thread(my_node->comp_thread[shard], (PLACE_ANY == place->completion_core) ? PLACE_ANY : place->completion_core + (int)shard);
+        pin_thread(my_node->persist_thread[shard], (PLACE_ANY == place->persistence_core) ? PLACE_ANY : place->persistence_core + (int)shard);
+        sprintf(name, "replica %"PRIu32, shard);
+        thread_placement_display(stderr, name, my_node->rep_thread[shard]);
+        sprintf(name, "completion %"PRIu32, shard);
+        thread_placement_display(stderr, name, my_node->comp_thread[shard]);
+        sprintf(name, "persistence %"PRIu32, shard);
+        thread_placement_display(stderr, name, my_node->persist_thread[shard]);
+    }
     return rc;
 }
 
-int initialize_node(node* my_node, const char* log_path, void (*user_cb)(db_key_type index,void* arg), void (*up_check)(void* arg), int (*up_get)(view_stamp clt_id,void* arg), void* db_ptr, void* arg){
+int initialize_node(node* my_node, const char* log_path, void (*user_cb)(db_key_type index,void* record,void* arg), void (*up_check)(void* arg), int (*up_get)(view_stamp clt_id,void* arg), void* db_ptr, void* arg){
 
     int flag = 1;
 
@@ -66,15 +103,16 @@ int initialize_node(node* my_node, const char* log_path, void (*user_cb)(db_key_
             }
     }
 
-    my_node->consensus_comp = NULL;
-
-    my_node->consensus_comp = init_consensus_comp(my_node,
-            my_node->node_id,my_node->sys_log_file,my_node->sys_log,
-            my_node->stat_log,my_node->db_name,db_ptr,my_node->group_size,
-            &my_node->cur_view,&my_node->highest_to_commit,&my_node->highest_committed,
-            &my_node->highest_seen,user_cb,up_check,up_get,arg);
-    if(NULL==my_node->consensus_comp){
-        goto initialize_node_exit;
+    uint32_t shard;
+    for(shard=0;shard<my_node->shard_count;shard++){
+        my_node->consensus_comp[shard] = init_consensus_comp(my_node,shard,
+                my_node->node_id,my_node->sys_log_file,my_node->sys_log,
+                my_node->stat_log,my_node->db_name,db_ptr,my_node->group_size,
+                &my_node->cur_view,&my_node->highest_to_commit[shard],&my_node->highest_committed[shard],
+                &my_node->highest_seen[shard],user_cb,up_check,up_get,arg);
+        if(NULL==my_node->consensus_comp[shard]){
+            goto initialize_node_exit;
+        }
     }
     
     flag = 0;
@@ -83,9 +121,34 @@ initialize_node_exit:
     return flag;
 }
 
-dare_log_entry_t* rsm_op(node* my_node, size_t ret, void *buf, uint8_t type, view_stamp* clt_id)
+dare_log_entry_t* rsm_op(node* my_node, uint32_t shard, size_t ret, void *buf, uint8_t type, view_stamp* clt_id)
+{
+    return leader_handle_submit_req(my_node->consensus_comp[shard],ret,buf,type,clt_id);
+}
+
+int rsm_op_async(node* my_node, uint32_t shard, size_t ret, void *buf, uint8_t type, view_stamp* clt_id, rsm_ticket* ticket)
+{
+    return leader_submit_req_async(my_node->consensus_comp[shard],ret,buf,type,clt_id,ticket);
+}
+
+int rsm_completion_fd(node* my_node, uint32_t shard)
+{
+    return consensus_completion_fd(my_node->consensus_comp[shard]);
+}
+
+int rsm_output_ack(node* my_node, dare_log_entry_t* entry, uint32_t node_id, accept_ack* ack)
+{
+    return leader_output_ack(my_node->consensus_comp[VS_SHARD(&entry->msg_vs)],entry,node_id,ack);
+}
+
+int leader_lease_valid(node* my_node)
 {
-    return leader_handle_submit_req(my_node->consensus_comp,ret,buf,type,clt_id);
+    return my_node->cur_view.leader_id == *my_node->node_id && dare_lease_valid();
+}
+
+uint32_t get_shard_count(node* my_node)
+{
+    return my_node->shard_count;
 }
 
 uint32_t get_leader_id(node* my_node)
@@ -93,12 +156,21 @@ uint32_t get_leader_id(node* my_node)
     return my_node->cur_view.leader_id;
 }
 
+uint64_t rsm_proposals(node* my_node)
+{
+    uint64_t proposals = 0;
+    uint32_t shard;
+    for(shard=0;shard<my_node->shard_count;shard++)
+        proposals += my_node->highest_seen[shard].req_id;
+    return proposals;
+}
+
 uint32_t get_group_size(node* my_node)
 {
     return my_node->group_size;
 }
 
-node* system_initialize(node_id_t* node_id, const char* config_path, const char* log_path, void(*user_cb)(db_key_type index,void* arg), void(*up_check)(void* arg), int(*up_get)(view_stamp clt_id, void*arg), void* db_ptr, void* arg, const char* start_mode){
+node* system_initialize(node_id_t* node_id, const char* config_path, const char* log_path, void(*user_cb)(db_key_type index,void* record,void* arg), void(*up_check)(void* arg), int(*up_get)(view_stamp clt_id, void*arg), void* db_ptr, void* arg, const char* start_mode){
 
     node* my_node = (node*)malloc(sizeof(node));
     memset(my_node,0,sizeof(node));
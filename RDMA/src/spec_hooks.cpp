@@ -3,7 +3,8 @@
 #include <dlfcn.h>
 #include <stdlib.h>
 #include <pthread.h>
-#include <sys/stat.h>
+#include <stdarg.h>
+#include <fcntl.h>
 #include "include/rsm-interface.h"
 
 #define dprintf(fmt...)
@@ -132,6 +133,21 @@ extern "C" pid_t fork(void)
 
 
 
+extern "C" int socket(int domain, int type, int protocol)
+{
+	typedef int (*orig_socket_type)(int, int, int);
+	static orig_socket_type orig_socket;
+	if (!orig_socket)
+		orig_socket = (orig_socket_type) dlsym(RTLD_NEXT, "socket");
+
+	int ret = orig_socket(domain, type, protocol);
+
+	if (ret >= 0 && ev_mgr != NULL)
+		mgr_on_socket(ret, ev_mgr);
+
+	return ret;
+}
+
 extern "C" int accept4(int socket, struct sockaddr *address, socklen_t *address_len, int flags)
 {
 	typedef int (*orig_accept4_type)(int, sockaddr *, socklen_t *,int);
@@ -142,12 +158,7 @@ extern "C" int accept4(int socket, struct sockaddr *address, socklen_t *address_
 	int ret = orig_accept4(socket, address, address_len, flags);
 
 	if (ret >= 0 && ev_mgr != NULL)
-	{
-		struct stat sb;
-		fstat(ret, &sb);
-		if ((sb.st_mode & S_IFMT) == S_IFSOCK)
-			mgr_on_accept(ret, ev_mgr);
-	}
+		mgr_on_accept(ret, ev_mgr);
 
 	return ret;
 }
@@ -166,25 +177,181 @@ extern "C" int accept(int socket, struct sockaddr *address, socklen_t *address_l
 	int ret = orig_accept(socket, address, address_len);
 
 	if (ret >= 0 && ev_mgr != NULL)
+		mgr_on_accept(ret, ev_mgr);
+
+	return ret;
+}
+
+extern "C" int socketpair(int domain, int type, int protocol, int sv[2])
+{
+	typedef int (*orig_socketpair_type)(int, int, int, int*);
+	static orig_socketpair_type orig_socketpair;
+	if (!orig_socketpair)
+		orig_socketpair = (orig_socketpair_type) dlsym(RTLD_NEXT, "socketpair");
+
+	int ret = orig_socketpair(domain, type, protocol, sv);
+
+	if (ret == 0 && ev_mgr != NULL)
 	{
-		struct stat sb;
-		fstat(ret, &sb);
-		if ((sb.st_mode & S_IFMT) == S_IFSOCK)
-			mgr_on_accept(ret, ev_mgr);
+		mgr_on_socket(sv[0], ev_mgr);
+		mgr_on_socket(sv[1], ev_mgr);
+	}
+
+	return ret;
+}
+
+extern "C" int dup(int oldfd)
+{
+	typedef int (*orig_dup_type)(int);
+	static orig_dup_type orig_dup;
+	if (!orig_dup)
+		orig_dup = (orig_dup_type) dlsym(RTLD_NEXT, "dup");
+
+	int ret = orig_dup(oldfd);
+
+	if (ret >= 0 && ev_mgr != NULL)
+		mgr_on_dup(ret, ev_mgr);
+
+	return ret;
+}
+
+extern "C" int dup2(int oldfd, int newfd)
+{
+	typedef int (*orig_dup2_type)(int, int);
+	static orig_dup2_type orig_dup2;
+	if (!orig_dup2)
+		orig_dup2 = (orig_dup2_type) dlsym(RTLD_NEXT, "dup2");
+
+	int ret = orig_dup2(oldfd, newfd);
+
+	// dup2(fd, fd) changes nothing
+	if (ret >= 0 && ret != oldfd && ev_mgr != NULL)
+		mgr_on_dup(ret, ev_mgr);
+
+	return ret;
+}
+
+extern "C" int dup3(int oldfd, int newfd, int flags)
+{
+	typedef int (*orig_dup3_type)(int, int, int);
+	static orig_dup3_type orig_dup3;
+	if (!orig_dup3)
+		orig_dup3 = (orig_dup3_type) dlsym(RTLD_NEXT, "dup3");
+
+	int ret = orig_dup3(oldfd, newfd, flags);
+
+	if (ret >= 0 && ev_mgr != NULL)
+		mgr_on_dup(ret, ev_mgr);
+
+	return ret;
+}
+
+typedef int (*orig_fcntl_type)(int, int, ...);
+
+// what the third argument of fcntl() is for cmd
+enum fcntl_arg { FCNTL_ARG_NONE, FCNTL_ARG_INT, FCNTL_ARG_PTR };
+
+static fcntl_arg fcntl_arg_kind(int cmd)
+{
+	switch (cmd) {
+	case F_GETFD:
+	case F_GETFL:
+	case F_GETOWN:
+#ifdef F_GETSIG
+	case F_GETSIG:
+#endif
+#ifdef F_GETLEASE
+	case F_GETLEASE:
+#endif
+#ifdef F_GETPIPE_SZ
+	case F_GETPIPE_SZ:
+#endif
+#ifdef F_GET_SEALS
+	case F_GET_SEALS:
+#endif
+		return FCNTL_ARG_NONE;
+	case F_GETLK:
+	case F_SETLK:
+	case F_SETLKW:
+#if defined(F_GETLK64) && F_GETLK64 != F_GETLK
+	case F_GETLK64:
+	case F_SETLK64:
+	case F_SETLKW64:
+#endif
+#ifdef F_OFD_GETLK
+	case F_OFD_GETLK:
+	case F_OFD_SETLK:
+	case F_OFD_SETLKW:
+#endif
+#ifdef F_GETOWN_EX
+	case F_GETOWN_EX:
+	case F_SETOWN_EX:
+#endif
+#ifdef F_GET_RW_HINT
+	case F_GET_RW_HINT:
+	case F_SET_RW_HINT:
+	case F_GET_FILE_RW_HINT:
+	case F_SET_FILE_RW_HINT:
+#endif
+		return FCNTL_ARG_PTR;
+	default:
+		return FCNTL_ARG_INT;
+	}
+}
+
+// the third argument is read as the type cmd takes, and passed on as that type
+static int hooked_fcntl(orig_fcntl_type orig_fcntl, int fd, int cmd, va_list ap)
+{
+	int ret;
+	switch (fcntl_arg_kind(cmd)) {
+	case FCNTL_ARG_NONE:
+		ret = orig_fcntl(fd, cmd);
+		break;
+	case FCNTL_ARG_PTR:
+		ret = orig_fcntl(fd, cmd, va_arg(ap, void*));
+		break;
+	default:
+		ret = orig_fcntl(fd, cmd, va_arg(ap, int));
+		break;
 	}
 
+	if (ret >= 0 && ev_mgr != NULL && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC))
+		mgr_on_dup(ret, ev_mgr);
+
+	return ret;
+}
+
+extern "C" int fcntl(int fd, int cmd, ...)
+{
+	static orig_fcntl_type orig_fcntl;
+	if (!orig_fcntl)
+		orig_fcntl = (orig_fcntl_type) dlsym(RTLD_NEXT, "fcntl");
+
+	va_list ap;
+	va_start(ap, cmd);
+	int ret = hooked_fcntl(orig_fcntl, fd, cmd, ap);
+	va_end(ap);
+	return ret;
+}
+
+// what fcntl() becomes with _FILE_OFFSET_BITS=64
+extern "C" int fcntl64(int fd, int cmd, ...)
+{
+	static orig_fcntl_type orig_fcntl64;
+	if (!orig_fcntl64)
+		orig_fcntl64 = (orig_fcntl_type) dlsym(RTLD_NEXT, "fcntl64");
+
+	va_list ap;
+	va_start(ap, cmd);
+	int ret = hooked_fcntl(orig_fcntl64, fd, cmd, ap);
+	va_end(ap);
 	return ret;
 }
 
 extern "C" int close(int fildes)
 {
 	if (ev_mgr != NULL)
-	{
-		struct stat sb;
-		fstat(fildes, &sb);
-		if ((sb.st_mode & S_IFMT) == S_IFSOCK)
-			mgr_on_close(fildes, ev_mgr);
-	}
+		mgr_on_close(fildes, ev_mgr);
 
 	typedef int (*orig_close_type)(int);
 	static orig_close_type orig_close;
@@ -259,19 +426,10 @@ extern "C" ssize_t write(int fd, const void *buf, size_t count)
 		orig_write = (orig_write_type) dlsym(RTLD_NEXT, "write");
 	ssize_t ret = orig_write(fd, buf, count);
 
+	// mgr_on_check() looks the fd up in the fd table, filled by the socket(), accept() and
+	// dup hooks; an fd none of them saw is fstat()ed once
 	if (ret > 0 && ev_mgr != NULL)
-	{
-		struct stat sb;
-		fstat(fd, &sb);
-		if ((sb.st_mode & S_IFMT) == S_IFSOCK)
-		{
-			// It is better to differ unix socket and tcp socket and here.
-			// 1. to seperate based on whether libevent thread. [This check has been done in the mgr_on_check.]
-			// 2. to seperate by calling getsockopt.
-			dprintf("[TODO] fd %d will be passed into mgr_on_check. However open tcp socket is valid not unix socket is allowed.\n",fd);
-			mgr_on_check(fd, buf, ret, ev_mgr);
-		}
-	}
+		mgr_on_check(fd, buf, ret, ev_mgr);
 
 	return ret;
 }
@@ -285,12 +443,7 @@ extern "C" ssize_t send(int fd, const void *buf, size_t len, int flags)
 	ssize_t ret = orig_send(fd, buf, len, flags);
 
 	if (ret > 0 && ev_mgr != NULL)
-	{
-		struct stat sb;
-		fstat(fd, &sb);
-		if ((sb.st_mode & S_IFMT) == S_IFSOCK)
-			mgr_on_check(fd, buf, ret, ev_mgr);
-	}
+		mgr_on_check(fd, buf, ret, ev_mgr);
 
 	return ret;
 }
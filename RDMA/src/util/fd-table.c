@@ -0,0 +1,76 @@
+#include "../include/util/fd-table.h"
+
+#include <sys/stat.h>
+
+// fd_chunks[fd >> FD_CHUNK_BITS][fd & (FD_CHUNK_SIZE - 1)]; chunks are never freed
+static fd_state* volatile fd_chunks[MAX_FD_SIZE / FD_CHUNK_SIZE];
+
+fd_state* fd_state_get(int fd)
+{
+	if (fd < 0 || fd >= MAX_FD_SIZE)
+		return NULL;
+	fd_state* chunk = fd_chunks[fd >> FD_CHUNK_BITS];
+	if (NULL == chunk)
+		return NULL;
+	return &chunk[fd & (FD_CHUNK_SIZE - 1)];
+}
+
+fd_state* fd_state_touch(int fd)
+{
+	if (fd < 0 || fd >= MAX_FD_SIZE)
+		return NULL;
+	fd_state* chunk = fd_chunks[fd >> FD_CHUNK_BITS];
+	if (NULL == chunk) {
+		chunk = (fd_state*)calloc(FD_CHUNK_SIZE, sizeof(fd_state));
+		if (NULL == chunk)
+			return NULL;
+		if (!__sync_bool_compare_and_swap(&fd_chunks[fd >> FD_CHUNK_BITS], NULL, chunk)) {
+			// another thread installed the chunk first
+			free(chunk);
+			chunk = fd_chunks[fd >> FD_CHUNK_BITS];
+		}
+	}
+	return &chunk[fd & (FD_CHUNK_SIZE - 1)];
+}
+
+fd_state* fd_socket_open(int fd)
+{
+	fd_state* st = fd_state_touch(fd);
+	if (NULL == st)
+		return NULL;
+	st->type = FD_SOCKET;
+	return st;
+}
+
+fd_state* fd_state_classify(int fd)
+{
+	struct stat sb;
+	fd_state* st = fd_state_touch(fd);
+	if (NULL == st)
+		return NULL;
+	if (0 == fstat(fd, &sb) && S_ISSOCK(sb.st_mode))
+		st->type = FD_SOCKET;
+	else
+		st->type = FD_OTHER;
+	return st;
+}
+
+fd_state* fd_state_known(int fd)
+{
+	fd_state* st = fd_state_get(fd);
+	if (NULL != st && FD_UNKNOWN != st->type)
+		return st;
+	return fd_state_classify(fd);
+}
+
+void fd_state_foreach(void (*func)(int fd, fd_state* st, void* arg), void* arg)
+{
+	int i, j;
+	for (i = 0; i < MAX_FD_SIZE / FD_CHUNK_SIZE; i++) {
+		fd_state* chunk = fd_chunks[i];
+		if (NULL == chunk)
+			continue;
+		for (j = 0; j < FD_CHUNK_SIZE; j++)
+			func((i << FD_CHUNK_BITS) | j, &chunk[j], arg);
+	}
+}
@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include "../include/util/placement.h"
+
+#include <sched.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define MPOL_PREFERRED 1
+#define MPOL_F_NODE (1<<0)
+#define MPOL_F_ADDR (1<<1)
+
+int pin_thread(pthread_t thread, int core_id)
+{
+	if (PLACE_ANY == core_id)
+		return 0;
+
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(core_id, &cpuset);
+	if (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) != 0) {
+		fprintf(stderr, "pthread_setaffinity_np on core %d failed\n", core_id);
+		return 1;
+	}
+	return 0;
+}
+
+// NUMA node of the first RDMA device, or -1 if the kernel does not tell
+int nic_numa_node()
+{
+	int node = -1;
+	char path[512];
+	struct dirent* dev;
+
+	DIR* dir = opendir("/sys/class/infiniband");
+	if (NULL == dir)
+		return -1;
+	while (NULL != (dev = readdir(dir))) {
+		if ('.' == dev->d_name[0])
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/infiniband/%s/device/numa_node", dev->d_name);
+		FILE* fp = fopen(path, "r");
+		if (NULL == fp)
+			continue;
+		if (1 != fscanf(fp, "%d", &node))
+			node = -1;
+		fclose(fp);
+		break;
+	}
+	closedir(dir);
+	return node;
+}
+
+/* Pages are placed on numa_node when they are first touched; the policy is
+ * only a preference, so a full node falls back to the others. */
+static void numa_bind(void* addr, size_t size, int numa_node)
+{
+	if (PLACE_NIC_NODE == numa_node)
+		numa_node = nic_numa_node();
+	if (numa_node >= 0) {
+		unsigned long nodemask[4] = {0};
+		if (numa_node < (int)(sizeof(nodemask) * 8)) {
+			nodemask[numa_node / (sizeof(unsigned long) * 8)] = 1UL << (numa_node % (sizeof(unsigned long) * 8));
+			if (0 != syscall(SYS_mbind, addr, size, MPOL_PREFERRED, nodemask, sizeof(nodemask) * 8, 0))
+				fprintf(stderr, "mbind to NUMA node %d failed\n", numa_node);
+		}
+	}
+}
+
+void* numa_alloc(size_t size, int numa_node)
+{
+	void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == addr)
+		return NULL;
+	numa_bind(addr, size, numa_node);
+	return addr;
+}
+
+/* Maps size bytes of the file at path, creating or resizing it as needed;
+ * *existed tells whether the file already had exactly that size. */
+void* numa_map_file(const char* path, size_t size, int numa_node, int* existed)
+{
+	struct stat st;
+	int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	*existed = (0 == fstat(fd, &st) && (size_t)st.st_size == size);
+	if (!*existed && 0 != ftruncate(fd, size)) {
+		fprintf(stderr, "cannot resize %s: %s\n", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == addr)
+		return NULL;
+	numa_bind(addr, size, numa_node);
+	return addr;
+}
+
+void numa_free(void* addr, size_t size)
+{
+	if (NULL != addr)
+		munmap(addr, size);
+}
+
+void thread_placement_display(FILE* output, const char* name, pthread_t thread)
+{
+	cpu_set_t cpuset;
+	char cores[256];
+	int i, len = 0;
+
+	if (0 != pthread_getaffinity_np(thread, sizeof(cpu_set_t), &cpuset)) {
+		fprintf(output, "%s thread: affinity unknown\n", name);
+		return;
+	}
+	cores[0] = '\0';
+	for (i = 0; i < CPU_SETSIZE && len < (int)sizeof(cores) - 8; i++)
+		if (CPU_ISSET(i, &cpuset))
+			len += snprintf(cores + len, sizeof(cores) - len, "%s%d", len ? "," : "", i);
+	fprintf(output, "%s thread: cores %s\n", name, cores);
+}
+
+void memory_placement_display(FILE* output, const char* name, void* addr)
+{
+	int node = -1;
+	if (0 != syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR))
+		node = -1;
+	fprintf(output, "%s: NUMA node %d\n", name, node);
+}
@@ -0,0 +1,120 @@
+#include "../include/util/wait.h"
+
+#include <time.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define BILLION 1000000000L
+
+static uint64_t wait_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * BILLION + now.tv_nsec;
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__("pause" ::: "memory");
+#else
+	__sync_synchronize();
+#endif
+}
+
+int wait_mode_parse(const char* name, wait_mode* mode)
+{
+	if (0 == strcmp(name, "spin"))
+		*mode = WAIT_SPIN;
+	else if (0 == strcmp(name, "pause"))
+		*mode = WAIT_PAUSE;
+	else if (0 == strcmp(name, "park"))
+		*mode = WAIT_PARK;
+	else
+		return -1;
+	return 0;
+}
+
+void waiter_init(waiter* w, const wait_config* cfg, doorbell* bell, wait_stat* stat)
+{
+	w->cfg = cfg;
+	w->bell = bell;
+	w->stat = stat;
+	w->rounds = 0;
+	w->seq = 0;
+	w->idle_since = 0;
+	w->parked_ns = 0;
+}
+
+static void waiter_park(waiter* w)
+{
+	struct timespec timeout;
+	timeout.tv_sec = w->cfg->park_us / 1000000;
+	timeout.tv_nsec = (w->cfg->park_us % 1000000) * 1000;
+
+	uint64_t start = wait_now();
+	if (NULL == w->bell) {
+		// nobody can wake us (e.g. RDMA writes), so just sleep
+		nanosleep(&timeout, NULL);
+	} else {
+		__sync_fetch_and_add(&w->bell->sleepers, 1);
+		// returns at once if the doorbell rang since this idle period began
+		syscall(SYS_futex, &w->bell->seq, FUTEX_WAIT_PRIVATE, w->seq, &timeout, NULL, 0);
+		__sync_fetch_and_sub(&w->bell->sleepers, 1);
+		w->seq = w->bell->seq;
+	}
+	w->parked_ns += wait_now() - start;
+	__sync_fetch_and_add(&w->stat->parks, 1);
+}
+
+void waiter_idle(waiter* w)
+{
+	// counted in every mode, so waiter_busy reports the spin time of WAIT_SPIN too
+	if (0 == w->rounds) {
+		w->idle_since = wait_now();
+		if (NULL != w->bell)
+			w->seq = w->bell->seq;
+	}
+	// a long spin must not wrap back to 0 and restart the idle period
+	if (w->rounds < UINT32_MAX)
+		w->rounds++;
+
+	if (WAIT_SPIN == w->cfg->mode)
+		return;
+	if (WAIT_PARK == w->cfg->mode && w->rounds > w->cfg->spin_limit)
+		waiter_park(w);
+	else
+		cpu_relax();
+}
+
+void waiter_busy(waiter* w)
+{
+	if (0 == w->rounds)
+		return;
+
+	uint64_t idle_ns = wait_now() - w->idle_since;
+	__sync_fetch_and_add(&w->stat->spin_ns, idle_ns - w->parked_ns);
+	__sync_fetch_and_add(&w->stat->park_ns, w->parked_ns);
+	w->rounds = 0;
+	w->parked_ns = 0;
+}
+
+void doorbell_init(doorbell* bell)
+{
+	bell->seq = 0;
+	bell->sleepers = 0;
+}
+
+void doorbell_ring(doorbell* bell)
+{
+	__sync_fetch_and_add(&bell->seq, 1);
+	if (bell->sleepers > 0)
+		syscall(SYS_futex, &bell->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void wait_stat_display(FILE* output, const char* name, wait_stat* stat)
+{
+	safe_rec_log(output, "%s: spin %"PRIu64" ns, parked %"PRIu64" ns in %"PRIu64" parks\n",
+		name, stat->spin_ns, stat->park_ns, stat->parks);
+}
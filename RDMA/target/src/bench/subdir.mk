@@ -0,0 +1,29 @@
+# Benchmarks are stand-alone programs, built with "make bench"; they stay out of OBJS
+BENCHES += \
+./src/bench/entry-bytes \
+./src/bench/db-engines \
+./src/bench/crc64-throughput
+
+
+# Each benchmark is one source file, linked with the objects it needs
+src/bench/entry-bytes: ../src/bench/entry-bytes.c ./src/util/placement.o
+	@echo 'Building benchmark: $@'
+	@echo 'Invoking: GCC C Linker'
+	gcc-4.8 -std=gnu11 -DDEBUG=$(DEBUGOPT) -I"$(ROOT_DIR)/../.local/include" -O2 -Wall -o "$@" $^ -lpthread
+	@echo 'Finished building benchmark: $@'
+	@echo ' '
+
+src/bench/db-engines: ../src/bench/db-engines.c ./src/db/db-interface.o ./src/db/bdb-engine.o ./src/db/mem-engine.o ./src/db/wal.o ./src/util/common-structure.o
+	@echo 'Building benchmark: $@'
+	@echo 'Invoking: GCC C Linker'
+	gcc-4.8 -std=gnu11 -DDEBUG=$(DEBUGOPT) -I"$(ROOT_DIR)/../.local/include" -O2 -Wall -o "$@" $^ -L"$(ROOT_DIR)/../.local/lib" -ldb -lpthread -lrt
+	@echo 'Finished building benchmark: $@'
+	@echo ' '
+
+# built from the crc64 source at -O2, not from the library's -O0 object
+src/bench/crc64-throughput: ../src/bench/crc64-throughput.c ../src/output/crc64.c
+	@echo 'Building benchmark: $@'
+	@echo 'Invoking: GCC C Linker'
+	gcc-4.8 -std=gnu11 -DDEBUG=$(DEBUGOPT) -O2 -Wall -o "$@" $^ -lpthread
+	@echo 'Finished building benchmark: $@'
+	@echo ' '
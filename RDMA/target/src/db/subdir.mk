@@ -1,9 +1,15 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
-../src/db/db-interface.c 
+../src/db/db-interface.c \
+../src/db/bdb-engine.c \
+../src/db/mem-engine.c \
+../src/db/wal.c 
 
 OBJS += \
-./src/db/db-interface.o 
+./src/db/db-interface.o \
+./src/db/bdb-engine.o \
+./src/db/mem-engine.o \
+./src/db/wal.o 
 
 
 # Each subdirectory must supply rules for building sources it contributes
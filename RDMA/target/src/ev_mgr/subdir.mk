@@ -1,11 +1,17 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
 ../src/ev_mgr/ev_mgr.c \
-../src/ev_mgr/check_point_thread.c 
+../src/ev_mgr/check_point_thread.c \
+../src/ev_mgr/classifier.c \
+../src/ev_mgr/classifier-redis.c \
+../src/ev_mgr/classifier-memcached.c
 
 OBJS += \
 ./src/ev_mgr/ev_mgr.o \
-./src/ev_mgr/check_point_thread.o 
+./src/ev_mgr/check_point_thread.o \
+./src/ev_mgr/classifier.o \
+./src/ev_mgr/classifier-redis.o \
+./src/ev_mgr/classifier-memcached.o
 
 
 # Each subdirectory must supply rules for building sources it contributes
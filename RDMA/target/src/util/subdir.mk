@@ -1,11 +1,17 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
 ../src/util/common-structure.c \
-../src/util/clock.c
+../src/util/clock.c \
+../src/util/wait.c \
+../src/util/placement.c \
+../src/util/fd-table.c
 
 OBJS += \
 ./src/util/common-structure.o \
-./src/util/clock.o
+./src/util/clock.o \
+./src/util/wait.o \
+./src/util/placement.o \
+./src/util/fd-table.o
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -22,7 +22,7 @@ If the node_id is not itself, the command will route to the destnation, through
 The guard will launch criu to make a checkpoint, then wake up the RDMA program.
 Once the checkpoint dump files are created, they will be packed as a zip file then thie file will be copied to others through outer interface with the help of scp command.
 
-2. restore node_id round_id
+2. restore node_id[,node_id...] round_id
 A RDMA program (the leader) will send this command to $UNIX_SOCK. The guard will 
 If the node_id is not itself, the command will route to the destnation, through outer interface.
 
@@ -569,34 +569,39 @@ def route(cmd,node_id,round_id):
 
 # The handler for unix socket
 class InnerHandler(SocketServer.BaseRequestHandler):
+	# The RDMA program keeps its connection and may send several commands,
+	# one per line; a restore may name several nodes: restore 1,2 round_id
 	def handle(self):
 		print "[inner] Client is connected."
-		recv_size=4096
-		request = self.request.recv(recv_size)
+		for request in self.request.makefile('r'):
+			self.serve_line(request)
+
+	def serve_line(self,request):
 		request = request.strip('\n')
 		print "[inner] recv:#%s#"%(request)
 		parts = request.split()
 		if 3!=len(parts):
 			print "[inner] Invalied parameters."
-			self.request.sendall("[inner] ERROR")
+			self.request.sendall("[inner] ERROR\n")
 			return
 		else:
-			(cmd,node_id,round_id) = parts
-			print "[inner] cmd: %s , node_id: %s, round_id: %s"%(cmd,node_id,round_id)
+			(cmd,node_ids,round_id) = parts
+			print "[inner] cmd: %s , node_id: %s, round_id: %s"%(cmd,node_ids,round_id)
 			try:
-				node_id = int(node_id)
+				node_ids = [int(node_id) for node_id in node_ids.split(',')]
 				round_id = int(round_id)
 			except Exception as e:
 				print "[init] error: %s"%(str(e))
-				self.request.sendall("[inner] ERROR")
+				self.request.sendall("[inner] ERROR\n")
 				return
-			print "[inner] self_id: %d, node_id: %d"%(SELF_ID,node_id)
-			if SELF_ID == node_id: # This is a inner call
-				inner_service(cmd,node_id,round_id)	
-				self.request.sendall("[inner] OK. The calling is served.\n")
-			else: # This is a outer call
-				route(cmd,node_id,round_id)
-				self.request.sendall("[inner] OK. The calling is routed.\n")
+			print "[inner] self_id: %d, node_ids: %s"%(SELF_ID,node_ids)
+			# route first, a restore of this machine kills the RDMA program
+			for node_id in node_ids:
+				if SELF_ID != node_id: # This is a outer call
+					route(cmd,node_id,round_id)
+			if SELF_ID in node_ids: # This is a inner call
+				inner_service(cmd,SELF_ID,round_id)	
+			self.request.sendall("[inner] OK. The calling is served.\n")
 			sys.stdout.flush()
 
 # The function will start outer interface handler in a thread